@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ray.h"
+#include "tracestats.h"
+
+// anything rays can be traced through, so that a scene can be one bounding
+// volume or a structure over many of them
+class AccelerationStructure {
+public:
+  // most rays traced together as one packet, one for each bit of the mask of
+  // rays that hit
+  static const unsigned MAX_PACKET_SIZE = 64;
+
+  virtual ~AccelerationStructure();
+
+  // shortens the ray to its closest intersection, if there is one
+  virtual bool closestIntersection(Ray &ray) const = 0;
+
+  // whether anything blocks the ray before it reaches the end of its length,
+  // stopping at the first blocker found rather than the closest; the gap of
+  // shadowSegment is left untested at the far end
+  bool anyIntersection(const Ray &ray) const;
+
+  // as anyIntersection, but testing the whole length of a segment that has
+  // already been shortened, so that a structure nested in another, possibly
+  // at a different scale, leaves no second gap of its own
+  virtual bool anySegmentIntersection(const Ray &segment) const = 0;
+
+  // the closest intersection, following mirrors when topVolume is set; each
+  // ray traced, including every reflection, is counted in the trace stats
+  bool calculateIntersection(Ray &ray, bool topVolume = false) const;
+
+  // anyIntersection, counted in the trace stats
+  bool calculateAnyIntersection(const Ray &ray) const;
+
+  // shortens each of count rays, at most MAX_PACKET_SIZE, to its closest
+  // intersection, returning a mask with bit i set when ray i hit something;
+  // structures that can share
+  // one walk between rays starting together override this, and the rest
+  // trace them one at a time
+  virtual uint64_t closestIntersections(Ray *rays, unsigned count) const;
+
+  // closestIntersections counted in the trace stats, following mirrors one
+  // ray at a time when topVolume is set
+  uint64_t calculateIntersections(Ray *rays, unsigned count,
+                                  bool topVolume = false) const;
+
+  // whether anything blocks each of count rays, at most MAX_PACKET_SIZE,
+  // returning a mask with bit i set when ray i is blocked; as for
+  // closestIntersections, the rays are tested one at a time unless
+  // overridden
+  virtual uint64_t anyIntersections(const Ray *rays, unsigned count) const;
+
+  // anyIntersections, counted in the trace stats
+  uint64_t calculateAnyIntersections(const Ray *rays, unsigned count) const;
+
+protected:
+  // distance left untested at the far end of an occlusion query, so that the
+  // surface being lit never shadows itself; fixed, so that blockers close to
+  // the surface are found however far away the light is, and only widened on
+  // rays long enough for the rounding of their length to need more
+  static constexpr float SHADOW_EPSILON = 1e-2f;
+  static constexpr float SHADOW_RELATIVE_EPSILON = 1e-5f;
+
+  // the part of an occlusion query tested for blockers, short of its end by
+  // the larger of the two epsilons
+  static Ray shadowSegment(const Ray &ray);
+};
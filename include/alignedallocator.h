@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// allocator for standard containers that aligns storage to Alignment bytes,
+// so that cache line sized elements never straddle two lines
+template <typename T, size_t Alignment> class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  template <typename U> struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    // over allocate and keep the pointer malloc returned just before the
+    // aligned block, so that deallocate can find it again
+    void *raw = std::malloc(n * sizeof(T) + Alignment + sizeof(void *));
+    if (raw == nullptr) {
+      throw std::bad_alloc();
+    }
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void *);
+    uintptr_t aligned =
+        (start + Alignment - 1) & ~static_cast<uintptr_t>(Alignment - 1);
+    reinterpret_cast<void **>(aligned)[-1] = raw;
+
+    return reinterpret_cast<T *>(aligned);
+  }
+
+  void deallocate(T *p, size_t) {
+    std::free(reinterpret_cast<void **>(p)[-1]);
+  }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return false;
+}
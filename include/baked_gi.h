@@ -12,7 +12,7 @@ private:
   int total_bounces = 3;
   vec3 environment = vec3(1, 1, 1) * 0.2f;
 
-  const BoundingVolume &boundingVolume;
+  const AccelerationStructure &boundingVolume;
   void constructImage();
   vector<vector<vec3>> image;
   int resolution;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+
+#include "bvh.h"
+#include "cube.h"
+#include "kdtree.h"
+#include "myrand.h"
+#include "proxyvolume.h"
+#include "toplevelvolume.h"
+#include "uniformgrid.h"
+
+using std::cout;
+using std::endl;
+
+// timings of the ray tracing kernels on the loaded object, printed by the
+// bench mode
+class Benchmark {
+private:
+  const Ptr_Triangles &triangles;
+  const Cube &bounds;
+  vector<Ray> rays;
+
+  static double secondsSince(std::chrono::steady_clock::time_point start);
+
+  // rays from around the box towards random points inside it
+  static vector<Ray> raysInto(const Cube &bounds, unsigned rayCount);
+
+  // side by side rays spread across a pixel around each benchmark ray, in
+  // packets of side squared rays
+  vector<Ray> pixelRays(unsigned side) const;
+
+public:
+  Benchmark(const Ptr_Triangles &triangles, const Cube &bounds,
+            unsigned rayCount = 2000);
+
+  // the shape of the hierarchy: its SAH cost, depth, leaf sizes and how much
+  // its siblings overlap
+  static void printStatistics(const BoundingVolume &volume);
+
+  // cost of one node test for the seven slab volumes against plain boxes
+  void nodeCost(const BoundingVolume &volume);
+
+  // triangle tests per second of the intersection kernel against the one it
+  // replaced, and of the packed kernel testing four at once
+  void triangleCost();
+
+  // time taken to build and to refit the hierarchy in each mode, against the
+  // quality of the result
+  void buildCost();
+
+  // build and trace times of the bounding volume against the kd-tree
+  void backendCost();
+
+  // build and trace times of the bounding volume against the grid, on
+  // generated terrain rather than the loaded object
+  void gridCost();
+
+  // size of the nodes in each layout against the time taken to trace them
+  void layoutCost();
+
+  // cache lines and pages each order of the binary nodes is expected to load
+  // per ray, against the time taken to trace them
+  void orderCost(const BoundingVolume &volume);
+
+  // cost of tracing the sixteen sub-pixel rays of a pixel as one packet,
+  // against tracing them one at a time
+  void packetCost(const BoundingVolume &volume);
+
+  // cost of a shadow ray found with a closest hit against the any hit query
+  void shadowCost(const BoundingVolume &volume);
+
+  // cost of the shadow rays from a point light to the points a pixel's rays
+  // land on, traced inside one frustum against one at a time
+  void frustumCost(const BoundingVolume &volume);
+
+  // size and trace times of the decimated proxy used by later bounces,
+  // against the full geometry, and how often the two agree about a ray
+  // hitting anything
+  void proxyCost(const BoundingVolume &volume);
+
+  // cost of building and tracing a thousand instances of the hierarchy,
+  // against the triangles they would need if each were a separate copy
+  void instanceCost(const BoundingVolume &volume);
+
+  void run(const BoundingVolume &volume);
+};
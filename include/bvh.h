@@ -1,29 +1,297 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <emmintrin.h>
+#include <string>
+
+#include "accelerationstructure.h"
+#include "alignedallocator.h"
+#include "packedtriangles.h"
 #include "ray.h"
 
 const float R3 = static_cast<float>(sqrt(3.0)) / 3.0f;
 
-// bounding volume is a tighter bounding box, which can contain some geometry
-// as
-// well as other bounding boxes
-class BoundingVolume {
+struct BuildTriangle;
+
+// bounding volume hierarchy of tighter bounding boxes, bounded by seven slabs
+// rather than three, stored as one contiguous array of nodes
+class BoundingVolume : public AccelerationStructure {
+public:
+  // a node fills exactly one cache line, and the two children of an interior
+  // node are stored next to each other
+  struct Node {
+    // near bounds of the seven slabs followed by their far bounds, so that
+    // each row loads straight into SIMD lanes
+    float d[2][7];
+    // index of the first child, or of the first triangle for leaves
+    unsigned offset;
+    // number of triangles, zero for interior nodes
+    unsigned count;
+
+    bool isLeaf() const { return count != 0; }
+  };
+
+  // four children side by side, so that one SSE slab test checks a ray
+  // against all of them; unused lanes hold empty bounds
+  struct WideNode {
+    // slab, near or far, child
+    float d[7][2][4];
+    // index of the child node, or of the first triangle for leaf children
+    unsigned offset[4];
+    // number of triangles in leaf children, zero for interior children
+    unsigned count[4];
+  };
+
+  // a wide node with each child's slabs stored as eight bit steps from the
+  // node's own bounds, half the size of a wide node at the cost of converting
+  // the steps back to distances while traversing
+  struct alignas(64) CompressedNode {
+    // near bound of the node along each slab, from which the children's
+    // bounds are stepped
+    float origin[7];
+    // each step along a slab is two to the power of its exponent
+    int8_t exponent[7];
+    // children in use, filling the lanes from the first
+    uint8_t laneCount;
+    // slab, near or far, child; near bounds round down and far bounds up, so
+    // a child's bounds only ever grow
+    uint8_t q[7][2][4];
+    unsigned offset[4];
+    // as wide as a wide node's, since a leaf may hold any number of
+    // triangles; it fits in what would otherwise be padding
+    unsigned count[4];
+  };
+
+  // Stackless walks the binary nodes in depth first order, skipping past the
+  // subtree of every node a ray misses, so that no stack is kept per ray
+  enum class Layout { Binary, Wide, Compressed, Stackless };
+
+  // orders of the binary nodes in memory, leaving the tree itself as it is;
+  // Treelets fills each page with the nodes below its first that a ray is
+  // most likely to visit, and is the order every build ends in
+  enum class NodeOrder { BreadthFirst, DepthFirst, Treelets };
+
+  // SAH partitions whole triangles, trying every split along each axis;
+  // Binned only tries the boundaries between a few bins, building faster and
+  // on every core; Spatial may also cut a triangle in two at a splitting
+  // plane, which builds slower but bounds large triangles tightly; Morton
+  // sorts triangles along a space filling curve and splits without any
+  // costs, fast enough to rebuild moving geometry every frame
+  enum class BuildMode { SAH, Binned, Spatial, Morton };
+
+  typedef vector<Node, AlignedAllocator<Node, 64>> Nodes;
+
+  // shape of the binary hierarchy, for tuning how it is built
+  struct Statistics {
+    float sahCost;
+    unsigned nodeCount;
+    unsigned leafCount;
+    unsigned maxDepth;
+    float averageLeafDepth;
+    // number of leaves holding each number of triangles
+    vector<unsigned> leafSizes;
+    // volume of the boxes shared by the two children of each interior node,
+    // summed over the nodes and divided by the volume of the root's box
+    float overlap;
+  };
+
+  // a ray's position and reciprocal direction along each slab normal,
+  // computed once per ray and laid out like the rows of a node
+  struct RaySlabs {
+    __m128 num[2];
+    __m128 inv[2];
+
+    RaySlabs() {}
+    RaySlabs(const Ray &ray);
+  };
+
+  // the range of every ray's position and reciprocal direction along each
+  // slab normal over a packet, for rejecting a node that all of them miss in
+  // one test
+  struct PacketSlabs {
+    __m128 numLo[2], numHi[2];
+    __m128 invLo[2], invHi[2];
+    // lanes of slabs the rays cross in both directions, and the unused last
+    // lane, which are left out of the test
+    __m128 ignored[2];
+
+    PacketSlabs(const RaySlabs *slabs, unsigned count);
+  };
+
 private:
-  const vec3 normals[7] = {vec3(1, 0, 0),       vec3(0, 1, 0),
-                           vec3(0, 0, 1),       vec3(1, 1, 1) * R3,
-                           vec3(-1, 1, 1) * R3, vec3(-1, -1, 1) * R3,
-                           vec3(1, -1, 1) * R3};
-  float d[7][2];
-  vector<BoundingVolume> subVolumes;
-  const Ptr_Triangles &triangles;
-  bool ClosestIntersection(Ray &ray) const;
-  bool anyIntersection(Ray &ray, Ray &surface) const;
-  bool calculateIntersectionSub(Ray &ray, float num[7], float denom[7]) const;
+  // cost of visiting a volume relative to testing one triangle
+  static constexpr float TRAVERSAL_COST = 1.0f;
+  // volumes with more triangles than this are always split
+  static const unsigned MAX_LEAF_SIZE = 16;
+  // below this depth only median splits are made, bounding the stack size
+  static const unsigned MAX_SAH_DEPTH = 32;
+  static const unsigned STACK_SIZE = 64;
+  // a wide node pushes up to four entries for every one it pops
+  static const unsigned WIDE_STACK_SIZE = 4 * STACK_SIZE;
+  // number of bins the centroids are sorted into along each axis
+  static const unsigned BINS = 16;
+  // ranges with more triangles than this are binned and built in parallel
+  static const unsigned TASK_SIZE = 4096;
+  // most tasks a range is binned in
+  static const unsigned MAX_CHUNKS = 64;
+  // number of planes along each axis at which triangles may be cut
+  static const unsigned SPATIAL_BINS = 32;
+  // spatial splits are only tried where the children of the best object split
+  // overlap by more than this fraction of the root's area
+  static constexpr float SPATIAL_OVERLAP = 1e-5f;
+  // references that cutting triangles may add, per triangle in the scene
+  static const unsigned SPATIAL_BUDGET = 1;
+  // bumped whenever the nodes or the cache layout change, so that stale caches
+  // are rebuilt rather than misread
+  static const uint32_t CACHE_VERSION = 2;
+  // size of the blocks treelets are packed into, a page of memory
+  static const unsigned TREELET_BYTES = 4096;
+  // shadow rays sharing a light are only bounded by one frustum when each
+  // heads within this cosine of the frustum's axis
+  static constexpr float FRUSTUM_MIN_COSINE = 0.5f;
+
+  Layout layout;
+  BuildMode buildMode;
+  unsigned leafSize;
+  // SAH cost when last built, against which refits are measured
+  float builtCost;
+  Nodes nodes;
+  vector<WideNode, AlignedAllocator<WideNode, 64>> wideNodes;
+  vector<CompressedNode, AlignedAllocator<CompressedNode, 64>> compressedNodes;
+  Nodes stacklessNodes;
+  // triangles in leaf order, each leaf refers to a contiguous range
+  Ptr_Triangles triangles;
+  // the triangles' corners in the same order, which is all that traversal
+  // reads until a hit; packed again whenever the triangles are built or move
+  PackedTriangles packed;
+
+  // state shared by every level of one build
+  struct BuildSettings {
+    BuildMode mode;
+    unsigned leafSize;
+    float rootArea;
+    // references that may still be created by cutting triangles
+    size_t splitBudget;
+  };
+
+  void build(const Ptr_Triangles &triangles);
+  static uint64_t hashTriangles(const Ptr_Triangles &triangles);
+  bool readCache(const std::string &fileName, const Ptr_Triangles &triangles);
+  bool parseCache(const char *data, size_t size,
+                  const Ptr_Triangles &triangles);
+  void writeCache(const std::string &fileName,
+                  const Ptr_Triangles &triangles) const;
+  void buildSub(unsigned index, BuildTriangle *begin, BuildTriangle *end,
+                BuildSettings &settings, unsigned depth);
+  static size_t findSplit(BuildTriangle *begin, BuildTriangle *end,
+                          unsigned leafSize, unsigned depth, float &cost);
+  void buildBinned(unsigned index, BuildTriangle *begin, BuildTriangle *end,
+                   const BuildTriangle *first, unsigned leafSize,
+                   unsigned depth, std::atomic<unsigned> *nodeCount);
+  static vector<unsigned>
+  sortByMortonCode(vector<BuildTriangle> &buildTriangles);
+  void buildMorton(unsigned index, BuildTriangle *begin, BuildTriangle *end,
+                   const unsigned *codes, const BuildTriangle *first,
+                   unsigned leafSize, std::atomic<unsigned> *nodeCount);
+  static size_t findBinnedSplit(BuildTriangle *begin, BuildTriangle *end,
+                                unsigned leafSize, unsigned depth);
+  static float findSpatialSplit(const BuildTriangle *begin,
+                                const BuildTriangle *end, int &axis,
+                                float &position);
+  static size_t spatialSplit(const BuildTriangle *begin,
+                             const BuildTriangle *end, int axis, float position,
+                             vector<BuildTriangle> &references);
+  unsigned collapse(unsigned index);
+  void compress();
+  static void quantise(const WideNode &wide, CompressedNode &node);
+  void appendStackless(unsigned index, Nodes &ordered) const;
+  bool binaryClosestIntersection(Ray &ray) const;
+  bool wideClosestIntersection(Ray &ray) const;
+  bool binaryAnyIntersection(const Ray &ray) const;
+  bool wideAnyIntersection(const Ray &ray) const;
+  bool compressedClosestIntersection(Ray &ray) const;
+  bool compressedAnyIntersection(const Ray &ray) const;
+  bool stacklessClosestIntersection(Ray &ray) const;
+  bool stacklessAnyIntersection(const Ray &ray) const;
+  // whether every ray heads the same way along each axis, so that one order
+  // of visiting children is front to back for all of them
+  static bool isCoherent(const Ray *rays, unsigned count);
+  uint64_t packetClosestIntersection(Ray *rays, unsigned count) const;
+  // whether every ray starts from the same point, as shadow rays cast from a
+  // point light do
+  static bool sharesOrigin(const Ray *rays, unsigned count);
+  uint64_t frustumAnyIntersection(const Ray *rays, unsigned count) const;
 
 public:
-  BoundingVolume(const Ptr_Triangles &triangles);
-  bool calculateIntersection(Ray &ray, bool topVolume = false) const;
-  void setSubVolume(BoundingVolume volume);
-  bool calculateAnyIntersection(Ray &ray, Ray &surface,
-                                bool topVolume = false) const;
+  static const vec3 normals[7];
+
+  // builds a hierarchy over an unordered triangle soup, choosing each split
+  // with the surface area heuristic
+  BoundingVolume(const Ptr_Triangles &triangles,
+                 BuildMode mode = BuildMode::SAH, unsigned leafSize = 4);
+  // loads the hierarchy from the cache file if it was built over the same
+  // triangles, in the same order, mode and leaf size, otherwise builds it and
+  // writes the cache for next time
+  BoundingVolume(const Ptr_Triangles &triangles, const std::string &cacheName,
+                 BuildMode mode = BuildMode::SAH, unsigned leafSize = 4);
+  // switches traversal between the binary nodes, four wide nodes collapsed
+  // from them, those wide nodes compressed and the binary nodes reordered for
+  // stackless walks, which are built the first time they are needed
+  void setLayout(Layout layout);
+  // the binary nodes in depth first order, each interior node followed by
+  // its first child and its offset replaced by the index of the node after
+  // its subtree; leaves are left as they are, as the node after a leaf is
+  // always the next one
+  Nodes stackless() const;
+  // size of the nodes traversed in the current layout
+  size_t nodeBytes() const;
+  // moves the binary nodes into the given order, keeping children in pairs
+  // after their parent; the other layouts are built from the binary nodes
+  // again
+  void reorder(NodeOrder order);
+  // expected number of blocks of the binary nodes a ray through the root
+  // loads, for blocks of the given size, counting a node whenever it lies in
+  // another block from its parent and weighting it by the chance of visiting
+  // it; a cache model of the node order rather than of the tree
+  float layoutCost(unsigned blockBytes) const;
+  const Nodes &getNodes() const;
+  // triangles in leaf order, where a triangle cut by a spatial split appears
+  // once for every leaf holding part of it
+  const Ptr_Triangles &getTriangles() const;
+  // expected cost of a random ray, in triangle tests, by the surface area
+  // heuristic
+  float sahCost() const;
+  Statistics statistics() const;
+  // fits the bounds to triangles that have moved without changing which
+  // triangles each node holds, which is much cheaper than building again;
+  // once the SAH cost has grown past maxCostGrowth times its cost when built,
+  // the hierarchy is rebuilt instead, and true is returned; a triangle cut by
+  // spatial splits is bounded whole in each of its leaves after a refit
+  bool refit(float maxCostGrowth = 2.0f);
+  // finds where the ray enters the node, only counting the part of the ray
+  // between its position and tMax
+  static bool intersectsNode(const Node &node, const RaySlabs &slabs,
+                             float tMax, float &tNear);
+  // whether every ray of a packet certainly misses the node before tMax; by
+  // interval arithmetic, so some nodes all the rays miss are still let
+  // through
+  static bool packetMissesNode(const Node &node, const PacketSlabs &packet,
+                               float tMax);
+  bool closestIntersection(Ray &ray) const override;
+  bool anySegmentIntersection(const Ray &segment) const override;
+  // coherent packets walk the binary nodes together whatever the layout,
+  // while packets whose rays head different ways are traced one at a time
+  uint64_t closestIntersections(Ray *rays, unsigned count) const override;
+  // rays cast from one point walk the binary nodes together inside the
+  // frustum bounding them, whatever the layout, and others are traced one at
+  // a time
+  uint64_t anyIntersections(const Ray *rays, unsigned count) const override;
 };
+
+static_assert(sizeof(BoundingVolume::Node) == 64,
+              "a node should fill exactly one cache line");
+static_assert(sizeof(BoundingVolume::WideNode) == 256,
+              "a wide node should fill exactly four cache lines");
+static_assert(sizeof(BoundingVolume::CompressedNode) == 128,
+              "a compressed node should fill exactly two cache lines");
@@ -43,4 +43,6 @@ inline vec3 floatToVec(cl_float3 clf) {
 
 
 
-Accelerator getGPU(int triangleCount);
\ No newline at end of file
+// builds the kernels for the number of triangles and of stackless bounding
+// volume nodes they will be given
+Accelerator getGPU(int triangleCount, int nodeCount);
\ No newline at end of file
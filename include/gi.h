@@ -11,11 +11,15 @@ private:
   int total_bounces = 3;
   vec3 environment = vec3(1, 1, 1) * 0.1f;
 
-  const BoundingVolume &boundingVolume;
+  const AccelerationStructure &boundingVolume;
+  // simplified geometry traced by bounces after the first, and by the shadow
+  // rays of the points they reach, if given
+  const AccelerationStructure *proxyVolume;
 
 public:
   GlobalIllumination();
-  GlobalIllumination(const Scene &scene, int sampleCount);
+  GlobalIllumination(const Scene &scene, int sampleCount,
+                     const AccelerationStructure *proxyVolume = nullptr);
 
   vec3 calculateLight(Ray &ray, ivec2 pixel = ivec2(0, 0)) override;
 };
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "accelerationstructure.h"
+#include "cube.h"
+
+// one placement of a shared acceleration structure in the world, so that many
+// copies of an object need only one copy of its triangles and hierarchy
+class Instance {
+private:
+  const AccelerationStructure *volume;
+  // bounds of the object in its own space
+  Cube objectBounds;
+  // object space to world space is transform * position + translation
+  mat3 transform, inverse, normalTransform;
+  vec3 translation;
+  // world space box around the transformed object bounds
+  Cube bounds;
+
+public:
+  Instance(const AccelerationStructure &volume, const Cube &objectBounds,
+           mat3 transform = mat3(1.0f), vec3 translation = vec3());
+
+  void setTransform(mat3 transform, vec3 translation);
+
+  const AccelerationStructure &getVolume() const;
+
+  const Cube &getBounds() const;
+
+  // corners of the object bounds placed in the world, which bound the
+  // instance more tightly than the box around them
+  vector<vec3> getCorners() const;
+
+  vec3 toWorld(vec3 position) const;
+
+  vec3 normalToWorld(vec3 normal) const;
+
+  // the ray in object space, where scale is how many object space units each
+  // world space unit along the ray becomes
+  Ray toObject(const Ray &ray, float &scale) const;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "accelerationstructure.h"
+#include "packedtriangles.h"
+
+// kd-tree whose planes are chosen with the surface area heuristic, suiting
+// scenes of large axis aligned triangles; every leaf keeps a rope to the
+// smallest node beyond each of its faces, so rays walk from leaf to leaf
+// without a stack
+class KdTree : public AccelerationStructure {
+public:
+  // interior nodes split along an axis, with both children stored together;
+  // leaves refer to one entry of the leaf array
+  struct Node {
+    float split;
+    // 0, 1 or 2 for the axis split along, LEAF for leaves
+    unsigned axis;
+    // index of the first child, or of the leaf
+    unsigned offset;
+  };
+
+  struct Leaf {
+    vec3 min, max;
+    // range of the leaf's triangles, which may also be in other leaves
+    unsigned first, count;
+    // node beyond each face, ordered -x, +x, -y, +y, -z, +z, or NONE where
+    // the face is on the edge of the tree
+    unsigned ropes[6];
+  };
+
+  static const unsigned LEAF = 3;
+  static const unsigned NONE = ~0u;
+
+private:
+  // costs of visiting a node and testing a triangle
+  static constexpr float TRAVERSAL_COST = 1.0f;
+  static constexpr float INTERSECTION_COST = 1.5f;
+  // fraction of the cost saved by splitting off empty space
+  static constexpr float EMPTY_BONUS = 0.2f;
+
+  vec3 min, max;
+  vector<Node> nodes;
+  vector<Leaf> leaves;
+  Ptr_Triangles triangles;
+  // the corners of the triangles, in the same order, which is all the leaves
+  // read until a hit
+  PackedTriangles packed;
+
+  void build(unsigned index, vector<unsigned> &references, vec3 min, vec3 max,
+             const vector<vec3> &triangleMin, const vector<vec3> &triangleMax,
+             const Ptr_Triangles &input, unsigned depth);
+  void attachRopes(unsigned index, const unsigned ropes[6]);
+  // the leaf holding point, descending from node index
+  unsigned findLeaf(unsigned index, vec3 point, vec3 direction) const;
+  // calls visit on each leaf the ray passes through in order, until it
+  // returns true or the ray leaves the tree
+  template <typename Visit>
+  void walk(const Ray &ray, Visit visit) const;
+
+public:
+  KdTree(const Ptr_Triangles &triangles);
+
+  const vector<Node> &getNodes() const;
+
+  const vector<Leaf> &getLeaves() const;
+
+  // triangles in leaf order, where a triangle spanning several leaves appears
+  // once in each of them
+  const Ptr_Triangles &getTriangles() const;
+
+  bool closestIntersection(Ray &ray) const override;
+  bool anySegmentIntersection(const Ray &segment) const override;
+};
@@ -48,7 +48,12 @@ public:
 
   bool update(float dt);
 
-  virtual vector<Ray> calculateRays(vec3 target) const = 0;
+  // a ray from a point on the light to the target, ending at the target;
+  // lights with more than one point pick a new one each time
+  virtual Ray calculateRay(vec3 target) const = 0;
+
+  // rayCount rays from points on the light to the target
+  vector<Ray> calculateRays(vec3 target) const;
 
   vec3 directLight(const Ray &ray) const;
 
@@ -28,4 +28,9 @@ public:
   virtual ~LightingEngine();
 
   virtual vec3 calculateLight(Ray &cameraRay, ivec2 pixel) = 0;
+
+  // the summed light of the camera rays whose bits are set in hits, out of
+  // count rays, at most a packet; lit one ray at a time unless overridden
+  virtual vec3 calculateLights(Ray *cameraRays, unsigned count, uint64_t hits,
+                               ivec2 pixel);
 };
@@ -18,9 +18,16 @@ using std::string;
 using std::vector;
 
 class Object {
+public:
+  // acceleration structures an object may be traced through
+  enum class Backend { BoundingVolume, KdTree, Grid };
+
 private:
   map<string, const Material *> materials;
-  map<string, Ptr_Triangles> groups;
+  // owned and mutable, so that the object can deform
+  map<string, vector<Triangle *>> groups;
+  // file the object was loaded from, beside which its hierarchy is cached
+  string fileName;
 
   void readMaterials(FILE *file);
 
@@ -47,10 +54,20 @@ private:
   vec3 readVec3(FILE *file);
 
 protected:
-  BoundingVolume getBoundingVolume(string groupName);
+  // how the object's bounding volume is built, which suits the geometry
+  BoundingVolume::BuildMode buildMode;
+  // what the object is best traced through
+  Backend backend;
 
   void load(string fileName);
 
+  // the object takes ownership of materials and triangles made for it rather
+  // than loaded
+  const Material *addMaterial(const string &name, Material *material);
+
+  void addTriangles(const string &groupName,
+                    const vector<Triangle *> &triangles);
+
 public:
   Object();
 
@@ -58,5 +75,16 @@ public:
 
   Ptr_Triangles allTriangles();
 
-  virtual BoundingVolume createBoundingVolume() = 0;
+  // the same triangles, to move before refitting the bounding volume
+  vector<Triangle *> allMutableTriangles();
+
+  void setBuildMode(BoundingVolume::BuildMode mode);
+
+  Backend getBackend() const;
+
+  void setBackend(Backend backend);
+
+  // built once and then read from a cache next to the object's file, as long
+  // as the file has not changed
+  virtual BoundingVolume createBoundingVolume();
 };
@@ -5,13 +5,20 @@
 class Box : public Object {
 public:
   Box();
-
-  BoundingVolume createBoundingVolume();
 };
 
 class Teapot : public Object {
 public:
   Teapot();
+};
+
+class Capsule : public Object {
+public:
+  Capsule();
+};
 
-  BoundingVolume createBoundingVolume();
+// generated hills of evenly sized triangles
+class Terrain : public Object {
+public:
+  Terrain(float width = 1000.0f, int maxHeight = 100, int resolution = 128);
 };
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include "alignedallocator.h"
+#include "triangle.h"
+
+// the corner and two edges of each of a list of triangles, which are all that
+// intersection tests read, packed as structure of arrays in the list's order;
+// a leaf's triangles then share a few cache lines, rather than each bringing
+// its texture coordinates, normals and material, which only the hit needs,
+// and any four neighbours load straight into SSE lanes
+class PackedTriangles {
+private:
+  typedef vector<float, AlignedAllocator<float, 16>> Floats;
+
+  // each array runs three floats past the last triangle, so that four lanes
+  // may be loaded from any triangle; the padding is degenerate and never hit
+  static const unsigned PADDING = 3;
+
+  // x, y and z of each
+  Floats v0[3], e1[3], e2[3];
+  // the triangles themselves, only read to record a hit
+  Ptr_Triangles triangles;
+
+  // Moller-Trumbore on the four triangles from first, taking the same steps
+  // as Triangle::intersects in each lane, and returning a mask of the lanes
+  // below count that the ray hits
+  int intersectFour(size_t first, size_t count, const __m128 position[3],
+                    const __m128 direction[3], float length, __m128 &t,
+                    __m128 &u, __m128 &v) const;
+
+public:
+  PackedTriangles();
+
+  // copies the triangles' current corners, so it is made again whenever
+  // they move
+  PackedTriangles(const Ptr_Triangles &triangles);
+
+  size_t size() const;
+
+  // tests the count triangles from first four at a time, as for Triangle,
+  // recording the closest hit in the ray
+  bool calculateIntersection(size_t first, size_t count, Ray &ray) const;
+
+  bool calculateAnyIntersection(size_t first, size_t count,
+                                const Ray &ray) const;
+};
@@ -7,5 +7,5 @@ public:
   PointLight(vec3 position, const Cube &bounds, float timePeriod, vec3 colour,
              float power);
 
-  vector<Ray> calculateRays(vec3 target) const override;
+  Ray calculateRay(vec3 target) const override;
 };
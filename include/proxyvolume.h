@@ -0,0 +1,39 @@
+#pragma once
+
+#include "bvh.h"
+
+// coarse stand in for detailed geometry, made by moving every vertex to the
+// average of the vertices in its cell of a grid and dropping the triangles
+// that collapse; meant for rays whose detail is lost anyway, such as diffuse
+// bounces and their shadows. The proxy strays from the true surface by up to
+// a cell's diagonal, so that much of every ray next to the surface is left
+// untested: the start of rays leaving a surface and the end of occlusion
+// queries cast towards one
+class ProxyVolume : public AccelerationStructure {
+private:
+  const float cellSize;
+  // owned, and decimated from the triangles given
+  vector<Triangle *> proxyTriangles;
+  BoundingVolume volume;
+
+  // the width of a cube shaped cell, resolution of which span the widest side
+  // of the triangles' bounding box
+  static float findCellSize(const Ptr_Triangles &triangles,
+                            unsigned resolution);
+  vector<Triangle *> decimate(const Ptr_Triangles &triangles) const;
+
+public:
+  ProxyVolume(const Ptr_Triangles &triangles, unsigned resolution = 32);
+
+  ProxyVolume(const ProxyVolume &other) = delete;
+
+  ~ProxyVolume();
+
+  Ptr_Triangles getTriangles() const;
+
+  // distance from a surface within which the proxy is not tested
+  float getTolerance() const;
+
+  bool closestIntersection(Ray &ray) const override;
+  bool anySegmentIntersection(const Ray &segment) const override;
+};
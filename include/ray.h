@@ -13,6 +13,7 @@ using glm::normalize;
 using std::numeric_limits;
 
 class Ray;
+class Instance;
 
 #include "triangle.h"
 
@@ -34,6 +35,10 @@ private:
 
   Triangle const *collision;
 
+  // the instance the collision was found in, whose transform places the
+  // triangle in the world, or null for triangles already in world space
+  Instance const *instance;
+
 public:
   Ray();
 
@@ -62,10 +67,18 @@ public:
 
   void updateCollision(const Ray &other);
 
+  // takes the collision of a ray traced through an instance in its own
+  // space, newLength being the distance to it in world space
+  void updateCollision(const Ray &objectRay, Instance const *newInstance,
+                       float newLength);
+
   vec3 collisionLocation() const;
 
   vec3 collisionNormal() const;
 
+  // the geometric normal of the triangle hit, rather than the shading normal
+  vec3 collisionFaceNormal() const;
+
   vec3 collisionAmbientColour() const;
 
   vec3 collisionDiffuseColour() const;
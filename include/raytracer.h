@@ -2,7 +2,7 @@
 
 #include <omp.h>
 
-#include "bvh.h"
+#include "accelerationstructure.h"
 #include "camera.h"
 #include "convergent_gi.h"
 #include "cube.h"
@@ -15,7 +15,7 @@ using std::numeric_limits;
 class RayTracer : public ObjectScreen {
 private:
   const Ptr_Triangles &triangles;
-  const BoundingVolume &boundingVolume;
+  const AccelerationStructure &boundingVolume;
 
   bool antialias;
   int chunkSize = 4000;
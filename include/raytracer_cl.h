@@ -47,12 +47,18 @@ private:
 	LightingEngine &lighting;
 	const BoundingVolume &boundingVolume;
 	void create_global_memory(int width, int height);
+	void upload_bounding_volume(const BoundingVolume::Nodes &nodes);
 	vector<vec3> averageImage;
 	bool refresh = false;
 	int frameCounter = 1;
 	Accelerator gpu;
 	cl_float3* cl_triangles;
 	cl::Buffer triangleBuffer;
+	// the volume's stackless nodes, whose leaves index leafTriangleBuffer
+	cl::Buffer nodeBuffer;
+	// index into triangleBuffer of each of the volume's triangles in leaf
+	// order, so that a triangle in several leaves keeps one index
+	cl::Buffer leafTriangleBuffer;
 	cl::Buffer lightBuffer;
 	cl::Buffer imageBuffer;
 	cl::Buffer cameraBuffer;
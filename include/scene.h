@@ -1,12 +1,12 @@
 #pragma once
 
-#include "bvh.h"
+#include "accelerationstructure.h"
 #include "cube.h"
 #include "lightingengine.h"
 
 struct Scene {
   Light &light;
   const Ptr_Triangles &triangles;
-  const BoundingVolume &volume;
+  const AccelerationStructure &volume;
   const Cube &bounds;
 };
@@ -13,5 +13,5 @@ public:
   SphereLight(vec3 position, const Cube &bounds, float timePeriod, vec3 colour,
               float power, float radius, int res);
 
-  vector<Ray> calculateRays(vec3 target) const override;
+  Ray calculateRay(vec3 target) const override;
 };
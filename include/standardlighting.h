@@ -4,9 +4,13 @@
 
 class StandardLighting final : public LightingEngine {
 private:
-  const BoundingVolume &boundingVolume;
+  const AccelerationStructure &boundingVolume;
 
 public:
   StandardLighting(const Scene &scene);
   vec3 calculateLight(Ray &cameraRay, ivec2 pixel = ivec2(0, 0)) override;
+  // the shadow rays towards each point of the light are traced together, so
+  // that those cast from a point light are culled against one frustum
+  vec3 calculateLights(Ray *cameraRays, unsigned count, uint64_t hits,
+                       ivec2 pixel) override;
 };
@@ -1,16 +1,21 @@
 #pragma once
 
-#include "scene.h"
 #include "triangle.h"
 
-using std::make_shared;
-
 class TerrainGenerator {
 private:
-  const shared_ptr<const vector<Triangle>> makePlane(float width,
-                                                     int resolution, vec3 pos);
+  // a square of resolution by resolution quads, each cut into two triangles
+  // facing up, with its corner at pos
+  vector<Triangle *> makePlane(float width, int resolution, vec3 pos,
+                               const Material *material);
+
+  // height of rolling hills at a point of a square of the given width
+  float height(float width, int maxHeight, float x, float z);
 
 public:
-  const shared_ptr<const vector<Triangle>>
-  generateTerrain(float width, int maxHeight, int resolution, vec3 pos);
+  // a plane raised into hills no higher than maxHeight; the triangles belong
+  // to the caller
+  vector<Triangle *> generateTerrain(float width, int maxHeight,
+                                     int resolution, vec3 pos,
+                                     const Material *material);
 };
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "bvh.h"
+#include "instance.h"
+
+// hierarchy over instances rather than triangles, each leaf holding one
+// instance whose own acceleration structure is traversed in object space;
+// moving an instance only rebuilds this level, never the shared hierarchies
+// below it, which are expected to hold triangles rather than more instances
+class TopLevelVolume : public AccelerationStructure {
+private:
+  static const unsigned STACK_SIZE = 64;
+
+  vector<Instance> instances;
+  BoundingVolume::Nodes nodes;
+  // index of the instance in each leaf, in leaf order
+  vector<unsigned> order;
+
+  void build();
+  void buildSub(unsigned index, unsigned *begin, unsigned *end,
+                const vector<vec3> &centroids);
+  void fitNode(unsigned index, const unsigned *begin, const unsigned *end);
+
+public:
+  TopLevelVolume(const vector<Instance> &instances);
+
+  // size cubed copies of an object spread over a grid, each turned a
+  // different way about the vertical
+  static vector<Instance> grid(const AccelerationStructure &volume,
+                               const Cube &objectBounds, unsigned size);
+
+  const vector<Instance> &getInstances() const;
+
+  // places an instance somewhere else in the world
+  void moveInstance(unsigned index, mat3 transform, vec3 translation);
+
+  // box around every instance
+  Cube getBounds() const;
+
+  bool closestIntersection(Ray &ray) const override;
+  bool anySegmentIntersection(const Ray &segment) const override;
+};
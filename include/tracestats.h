@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <omp.h>
+#include <vector>
+
+#include "alignedallocator.h"
+
+// counts of the work done tracing each kind of ray, kept by every thread in
+// its own cache line and summed once a frame, so that counting never makes
+// threads wait on each other; the counters are only compiled in when
+// TRACE_STATS is defined, and cost nothing otherwise
+class TraceStats {
+public:
+  enum class RayType { Camera, Shadow, Bounce };
+
+  static const unsigned RAY_TYPES = 3;
+
+  struct Counts {
+    uint64_t rays;
+    uint64_t nodes;
+    uint64_t triangles;
+  };
+
+private:
+  struct alignas(64) ThreadCounts {
+    // type of the rays the thread is tracing
+    RayType type;
+    Counts counts[RAY_TYPES];
+  };
+
+  typedef std::vector<ThreadCounts, AlignedAllocator<ThreadCounts, 64>>
+      Threads;
+
+  // one for each thread OpenMP may start, sized again whenever the counts
+  // are collected in case the number of threads has changed
+  static Threads threads;
+
+  // the calling thread's counters, or null for threads started beyond the
+  // count the array was sized for, whose work goes uncounted rather than
+  // racing on another thread's counters
+  static ThreadCounts *thread() {
+    const size_t index = omp_get_thread_num();
+    return (index < threads.size()) ? &threads[index] : nullptr;
+  }
+
+  static Counts *current() {
+    ThreadCounts *counts = thread();
+    return counts ? &counts->counts[static_cast<unsigned>(counts->type)]
+                  : nullptr;
+  }
+
+public:
+  // rays traced by the calling thread from now on are counted as this type
+  static void setRayType(RayType type) {
+#ifdef TRACE_STATS
+    if (ThreadCounts *counts = thread()) {
+      counts->type = type;
+    }
+#endif
+  }
+
+  static void countRay(unsigned count = 1) {
+#ifdef TRACE_STATS
+    if (Counts *counts = current()) {
+      counts->rays += count;
+    }
+#endif
+  }
+
+  static void countNode() {
+#ifdef TRACE_STATS
+    if (Counts *counts = current()) {
+      ++counts->nodes;
+    }
+#endif
+  }
+
+  static void countTriangle(unsigned count = 1) {
+#ifdef TRACE_STATS
+    if (Counts *counts = current()) {
+      counts->triangles += count;
+    }
+#endif
+  }
+
+  // sums every thread's counts of each type of ray and clears them; called
+  // outside of any parallel region
+  static void collect(Counts counts[RAY_TYPES]);
+
+  // prints the nodes visited and triangles tested per ray of each type since
+  // the last report; called once a frame, outside of any parallel region
+  static void report(std::ostream &out);
+};
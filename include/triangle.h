@@ -16,10 +16,14 @@ typedef vector<Ptr_Triangle> Ptr_Triangles;
 #include "ray.h"
 
 class Triangle {
+private:
+  bool intersects(const Ray &ray, float &t, vec2 &uv) const;
+
 public:
-  const vec3 v0, v1, v2, e1, e2;
+  // positions and normals change when the geometry deforms
+  vec3 v0, v1, v2, e1, e2;
   const vec2 vt0, vt1, vt2, et1, et2;
-  const vec3 vn0, vn1, vn2, en1, en2, normal;
+  vec3 vn0, vn1, vn2, en1, en2, normal;
   const Ptr_Material mat;
 
   static vec3 calculateNormal(vec3 v0, vec3 v1, vec3 v2);
@@ -34,8 +38,22 @@ public:
   Triangle(vec3 v0, vec3 v1, vec3 v2, vec2 vt0, vec2 vt1, vec2 vt2, vec3 vn0,
            vec3 vn1, vec3 vn2, const Material *const mat);
 
+  // moves the triangle, using its face normal at every vertex
+  void setVertices(vec3 v0, vec3 v1, vec3 v2);
+
+  void setVertices(vec3 v0, vec3 v1, vec3 v2, vec3 vn0, vec3 vn1, vec3 vn2);
+
+  // Moller-Trumbore against the triangle with corner v0 and edges e1 and e2,
+  // for callers keeping the corners apart from the rest of the triangle
+  static bool intersects(vec3 position, vec3 direction, float length, vec3 v0,
+                         vec3 e1, vec3 e2, float &t, vec2 &uv);
+
   bool calculateIntersection(Ray &ray) const;
 
+  // whether the triangle blocks the ray anywhere along its length, without
+  // recording the collision
+  bool calculateAnyIntersection(const Ray &ray) const;
+
   // Position
 
   vector<vec3> getVertices() const;
@@ -92,3 +110,45 @@ public:
 
   bool isMirrored() const;
 };
+
+// the determinant is the triple product of the direction and the edges,
+// negative for triangles facing the ray, and u, v and t are each one more
+// triple product sharing its cross products; u and v are compared scaled by
+// the determinant, so the only division is made once the ray is known to
+// cross the triangle; defined here so that it is inlined into traversal
+inline bool Triangle::intersects(vec3 position, vec3 direction, float length,
+                                 vec3 v0, vec3 e1, vec3 e2, float &t,
+                                 vec2 &uv) {
+  const vec3 p = glm::cross(direction, e2);
+  const float det = glm::dot(e1, p);
+  // back faces, and rays parallel to the triangle
+  if (!(det < 0.0f)) {
+    return false;
+  }
+
+  const vec3 b = position - v0;
+  const float uDet = glm::dot(b, p);
+  if (uDet > 0.0f || uDet < det) {
+    return false;
+  }
+
+  const vec3 q = glm::cross(b, e1);
+  const float vDet = glm::dot(direction, q);
+  if (vDet > 0.0f || uDet + vDet <= det) {
+    return false;
+  }
+
+  const float tDet = glm::dot(e2, q);
+  if (tDet > 0.0f) {
+    return false;
+  }
+
+  // rays may be of unbounded length, so t is compared with it unscaled
+  const float inverse = 1.0f / det;
+  t = tDet * inverse;
+  if (t >= length) {
+    return false;
+  }
+  uv = vec2(uDet * inverse, vDet * inverse);
+  return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "accelerationstructure.h"
+#include "packedtriangles.h"
+
+// grid of equal cells over the scene, each listing the triangles whose boxes
+// overlap it; cheaper to build and walk than a hierarchy when triangles are
+// small and spread evenly, as on tessellated terrain
+class UniformGrid : public AccelerationStructure {
+private:
+  // cells made for each triangle
+  static constexpr float CELL_DENSITY = 2.0f;
+  // most cells along any axis
+  static const int MAX_RESOLUTION = 256;
+  // axes narrower than this fraction of the widest are given a single cell,
+  // so that flat scenes are divided in two dimensions rather than three
+  static constexpr float FLAT_EXTENT = 1e-3f;
+
+  vec3 min, max;
+  vec3 cellSize;
+  int resolution[3];
+  // the triangles of cell i run from cellStart[i] to cellStart[i + 1]
+  vector<unsigned> cellStart;
+  Ptr_Triangles cellTriangles;
+  // the corners of the cells' triangles, in the same order, which is all the
+  // walk reads until a hit
+  PackedTriangles packed;
+
+  // the cell holding position along an axis, clamped into the grid
+  int cellAlong(int axis, float position) const;
+  // calls visit on each cell the ray passes through in order, until it
+  // returns true or the ray leaves the grid
+  template <typename Visit>
+  void walk(const Ray &ray, Visit visit) const;
+
+public:
+  UniformGrid(const Ptr_Triangles &triangles);
+
+  unsigned cellCount() const;
+
+  // triangles listed over all cells, where a triangle overlapping several
+  // cells is listed in each of them
+  size_t referenceCount() const;
+
+  bool closestIntersection(Ray &ray) const override;
+  bool anySegmentIntersection(const Ray &segment) const override;
+};
@@ -0,0 +1,86 @@
+#include "accelerationstructure.h"
+
+#include <algorithm>
+
+const unsigned AccelerationStructure::MAX_PACKET_SIZE;
+constexpr float AccelerationStructure::SHADOW_EPSILON;
+constexpr float AccelerationStructure::SHADOW_RELATIVE_EPSILON;
+
+AccelerationStructure::~AccelerationStructure() {}
+
+bool AccelerationStructure::calculateIntersection(Ray &ray,
+                                                  bool topVolume) const {
+  TraceStats::countRay();
+  bool intersection = closestIntersection(ray);
+  if (intersection && topVolume && ray.getCollision()->isMirrored()) {
+    ray.reflect();
+
+    return calculateIntersection(ray, true);
+  } else {
+    return intersection;
+  }
+}
+
+bool AccelerationStructure::anyIntersection(const Ray &ray) const {
+  return anySegmentIntersection(shadowSegment(ray));
+}
+
+bool AccelerationStructure::calculateAnyIntersection(const Ray &ray) const {
+  TraceStats::countRay();
+  return anyIntersection(ray);
+}
+
+uint64_t AccelerationStructure::closestIntersections(Ray *rays,
+                                                     unsigned count) const {
+  uint64_t hits = 0;
+  for (unsigned i = 0; i < count; i++) {
+    if (closestIntersection(rays[i])) {
+      hits |= uint64_t(1) << i;
+    }
+  }
+  return hits;
+}
+
+// reflected rays head off in all directions, so they leave the packet
+uint64_t AccelerationStructure::calculateIntersections(Ray *rays,
+                                                       unsigned count,
+                                                       bool topVolume) const {
+  TraceStats::countRay(count);
+
+  uint64_t hits = closestIntersections(rays, count);
+  for (unsigned i = 0; topVolume && i < count; i++) {
+    const uint64_t bit = uint64_t(1) << i;
+    if ((hits & bit) && rays[i].getCollision()->isMirrored()) {
+      rays[i].reflect();
+      if (!calculateIntersection(rays[i], true)) {
+        hits &= ~bit;
+      }
+    }
+  }
+  return hits;
+}
+
+uint64_t AccelerationStructure::anyIntersections(const Ray *rays,
+                                                 unsigned count) const {
+  uint64_t blocked = 0;
+  for (unsigned i = 0; i < count; i++) {
+    if (anyIntersection(rays[i])) {
+      blocked |= uint64_t(1) << i;
+    }
+  }
+  return blocked;
+}
+
+uint64_t
+AccelerationStructure::calculateAnyIntersections(const Ray *rays,
+                                                 unsigned count) const {
+  TraceStats::countRay(count);
+  return anyIntersections(rays, count);
+}
+
+Ray AccelerationStructure::shadowSegment(const Ray &ray) {
+  const float gap =
+      std::max(SHADOW_EPSILON, ray.getLength() * SHADOW_RELATIVE_EPSILON);
+  return Ray(ray.getPosition(), ray.getDirection(),
+             std::max(ray.getLength() - gap, 0.0f));
+}
@@ -0,0 +1,608 @@
+#include "benchmark.h"
+
+#include "objects.h"
+
+// rays towards the object, most of which hit something
+Benchmark::Benchmark(const Ptr_Triangles &triangles, const Cube &bounds,
+                     unsigned rayCount)
+    : triangles(triangles), bounds(bounds), rays(raysInto(bounds, rayCount)) {
+}
+
+vector<Ray> Benchmark::raysInto(const Cube &bounds, unsigned rayCount) {
+  vec3 extent = bounds.b - bounds.a;
+  vector<Ray> rays;
+  rays.reserve(rayCount);
+  for (unsigned i = 0; i < rayCount; i++) {
+    vec3 position = bounds.a - 0.5f * extent +
+                    2.0f * vec3(RAND(), RAND(), RAND()) * extent;
+    vec3 target = bounds.a + vec3(RAND(), RAND(), RAND()) * extent;
+    rays.emplace_back(position, target - position);
+  }
+  return rays;
+}
+
+double
+Benchmark::secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void Benchmark::printStatistics(const BoundingVolume &volume) {
+  const BoundingVolume::Statistics stats = volume.statistics();
+
+  cout << "hierarchy of " << stats.nodeCount << " nodes, SAH cost "
+       << stats.sahCost << endl;
+  cout << "  " << stats.leafCount << " leaves, " << stats.maxDepth
+       << " deep at most and " << stats.averageLeafDepth << " on average"
+       << endl;
+  cout << "  leaf sizes:";
+  for (size_t size = 0; size < stats.leafSizes.size(); size++) {
+    if (stats.leafSizes[size] != 0) {
+      cout << " " << size << "x" << stats.leafSizes[size];
+    }
+  }
+  cout << endl;
+  cout << "  siblings overlap by " << stats.overlap
+       << " times the root's volume" << endl;
+}
+
+// the test triangles used to run, solving for t, u and v by Cramer's rule
+// with four determinants
+static bool cramerIntersects(const Triangle &triangle, const Ray &ray) {
+  if (glm::dot(triangle.normal, ray.getDirection()) < 0) {
+    vec3 b = ray.getPosition() - triangle.v0;
+
+    glm::mat3 A(-ray.getDirection(), triangle.e1, triangle.e2);
+    float det_A = glm::determinant(A);
+
+    float t = glm::determinant(glm::mat3(b, triangle.e1, triangle.e2)) / det_A;
+    if (t >= 0 && t < ray.getLength()) {
+      float u = glm::determinant(
+                    glm::mat3(-ray.getDirection(), b, triangle.e2)) /
+                det_A;
+      float v = glm::determinant(
+                    glm::mat3(-ray.getDirection(), triangle.e1, b)) /
+                det_A;
+      return u >= 0.0f && v >= 0.0f && (u + v) < 1.0f;
+    }
+  }
+  return false;
+}
+
+void Benchmark::triangleCost() {
+  // enough of the triangles to outlast the timer's resolution
+  const size_t triangleCount = std::min<size_t>(triangles.size(), 1000);
+  const double tests = static_cast<double>(triangleCount) * rays.size();
+
+  cout << "triangle cost over " << triangleCount << " triangles and "
+       << rays.size() << " rays" << endl;
+
+  unsigned hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray &ray : rays) {
+    for (size_t i = 0; i < triangleCount; i++) {
+      hits += cramerIntersects(*triangles[i], ray);
+    }
+  }
+  double seconds = secondsSince(start);
+  cout << "  cramer:          " << tests / seconds / 1e6
+       << " million tests per second, " << hits << " hits" << endl;
+
+  hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Ray &ray : rays) {
+    for (size_t i = 0; i < triangleCount; i++) {
+      hits += triangles[i]->calculateAnyIntersection(ray);
+    }
+  }
+  seconds = secondsSince(start);
+  cout << "  moller-trumbore: " << tests / seconds / 1e6
+       << " million tests per second, " << hits << " hits" << endl;
+
+  const PackedTriangles packed(
+      Ptr_Triangles(triangles.begin(), triangles.begin() + triangleCount));
+  hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Ray &ray : rays) {
+    for (size_t i = 0; i < triangleCount; i += 4) {
+      hits += packed.calculateAnyIntersection(
+          i, std::min<size_t>(4, triangleCount - i), ray);
+    }
+  }
+  seconds = secondsSince(start);
+  cout << "  packed by four:  " << tests / seconds / 1e6
+       << " million tests per second, " << hits << " groups hit" << endl;
+}
+
+void Benchmark::nodeCost(const BoundingVolume &volume) {
+  const BoundingVolume::Nodes &nodes = volume.getNodes();
+  const double tests = static_cast<double>(nodes.size()) * rays.size();
+
+  cout << "node cost over " << nodes.size() << " nodes and " << rays.size()
+       << " rays" << endl;
+
+  // the scalar test the binary layout used to run, dividing by the ray
+  // direction along every slab
+  unsigned hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray &ray : rays) {
+    float num[7];
+    float denom[7];
+    for (int i = 0; i < 7; i++) {
+      num[i] = glm::dot(BoundingVolume::normals[i], ray.getPosition());
+      denom[i] = glm::dot(BoundingVolume::normals[i], ray.getDirection());
+    }
+    for (const BoundingVolume::Node &node : nodes) {
+      float tFar = ray.getLength();
+      float tNear = 0.0f;
+      int i = 0;
+      for (; i < 7; i++) {
+        float tn = (node.d[0][i] - num[i]) / denom[i];
+        float tf = (node.d[1][i] - num[i]) / denom[i];
+        if (denom[i] < 0)
+          std::swap(tn, tf);
+        tNear = (tn > tNear) ? tn : tNear;
+        tFar = (tf < tFar) ? tf : tFar;
+        if (tNear > tFar) {
+          break;
+        }
+      }
+      hits += (i == 7);
+    }
+  }
+  double seconds = secondsSince(start);
+  cout << "  k-DOP, scalar divides:    " << seconds / tests * 1e9
+       << "ns per node, " << 100.0 * hits / tests << "% hit" << endl;
+
+  hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Ray &ray : rays) {
+    const BoundingVolume::RaySlabs slabs(ray);
+    for (const BoundingVolume::Node &node : nodes) {
+      float tNear;
+      hits += BoundingVolume::intersectsNode(node, slabs, ray.getLength(),
+                                             tNear);
+    }
+  }
+  seconds = secondsSince(start);
+  cout << "  k-DOP, SIMD reciprocals:  " << seconds / tests * 1e9
+       << "ns per node, " << 100.0 * hits / tests << "% hit" << endl;
+
+  // the same nodes bounded only by their first three slabs, tested the way
+  // Cube does
+  vector<Cube> boxes;
+  boxes.reserve(nodes.size());
+  for (const BoundingVolume::Node &node : nodes) {
+    boxes.emplace_back(vec3(node.d[0][0], node.d[0][1], node.d[0][2]),
+                       vec3(node.d[1][0], node.d[1][1], node.d[1][2]));
+  }
+
+  hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (Ray ray : rays) {
+    for (const Cube &box : boxes) {
+      hits += box.calculateIntersection(ray);
+    }
+  }
+  seconds = secondsSince(start);
+  cout << "  AABB, scalar divides:     " << seconds / tests * 1e9
+       << "ns per node, " << 100.0 * hits / tests << "% hit" << endl;
+}
+
+void Benchmark::buildCost() {
+  const std::pair<const char *, BoundingVolume::BuildMode> modes[] = {
+      {"SAH:    ", BoundingVolume::BuildMode::SAH},
+      {"binned: ", BoundingVolume::BuildMode::Binned},
+      {"spatial:", BoundingVolume::BuildMode::Spatial},
+      {"Morton: ", BoundingVolume::BuildMode::Morton}};
+
+  cout << "build cost" << endl;
+
+  for (const auto &mode : modes) {
+    auto start = std::chrono::steady_clock::now();
+    BoundingVolume volume(triangles, mode.second);
+    double buildSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (Ray ray : rays) {
+      volume.calculateIntersection(ray);
+    }
+    double traceSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    volume.refit(0.0f);
+    double refitSeconds = secondsSince(start);
+
+    cout << "  " << mode.first << " " << buildSeconds * 1e3 << "ms ("
+         << buildSeconds / triangles.size() * 1e6
+         << "s per million triangles), refit " << refitSeconds * 1e3 << "ms, "
+         << volume.getNodes().size() << " nodes, "
+         << volume.getTriangles().size() << " references, SAH cost "
+         << volume.sahCost() << ", " << traceSeconds / rays.size() * 1e6
+         << "us per ray" << endl;
+  }
+}
+
+void Benchmark::backendCost() {
+  cout << "backend cost" << endl;
+
+  auto start = std::chrono::steady_clock::now();
+  BoundingVolume volume(triangles, BoundingVolume::BuildMode::Binned);
+  volume.setLayout(BoundingVolume::Layout::Wide);
+  double volumeSeconds = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  KdTree kdTree(triangles);
+  double kdTreeSeconds = secondsSince(start);
+
+  const std::pair<const char *, const AccelerationStructure *> backends[] = {
+      {"bounding volume:", &volume}, {"kd-tree:        ", &kdTree}};
+  const double buildSeconds[] = {volumeSeconds, kdTreeSeconds};
+
+  for (int i = 0; i < 2; i++) {
+    const AccelerationStructure &backend = *backends[i].second;
+
+    start = std::chrono::steady_clock::now();
+    for (Ray ray : rays) {
+      backend.calculateIntersection(ray);
+    }
+    double closestSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+      backend.calculateAnyIntersection(ray);
+    }
+    double anySeconds = secondsSince(start);
+
+    cout << "  " << backends[i].first << " built in " << buildSeconds[i] * 1e3
+         << "ms, closest hit " << closestSeconds / rays.size() * 1e6
+         << "us per ray, any hit " << anySeconds / rays.size() * 1e6
+         << "us per ray" << endl;
+  }
+
+  cout << "  kd-tree has " << kdTree.getLeaves().size() << " leaves, "
+       << kdTree.getTriangles().size() << " references" << endl;
+}
+
+void Benchmark::gridCost() {
+  Terrain terrain;
+  const Ptr_Triangles terrainTriangles = terrain.allTriangles();
+  const Cube terrainBounds(terrainTriangles);
+  const vector<Ray> terrainRays = raysInto(terrainBounds, rays.size());
+
+  cout << "grid cost over " << terrainTriangles.size()
+       << " triangles of terrain" << endl;
+
+  auto start = std::chrono::steady_clock::now();
+  BoundingVolume volume(terrainTriangles, BoundingVolume::BuildMode::Binned);
+  volume.setLayout(BoundingVolume::Layout::Wide);
+  double volumeSeconds = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  UniformGrid grid(terrainTriangles);
+  double gridSeconds = secondsSince(start);
+
+  const std::pair<const char *, const AccelerationStructure *> backends[] = {
+      {"bounding volume:", &volume}, {"grid:           ", &grid}};
+  const double buildSeconds[] = {volumeSeconds, gridSeconds};
+
+  for (int i = 0; i < 2; i++) {
+    const AccelerationStructure &backend = *backends[i].second;
+
+    start = std::chrono::steady_clock::now();
+    for (Ray ray : terrainRays) {
+      backend.calculateIntersection(ray);
+    }
+    double closestSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const Ray &ray : terrainRays) {
+      backend.calculateAnyIntersection(ray);
+    }
+    double anySeconds = secondsSince(start);
+
+    cout << "  " << backends[i].first << " built in " << buildSeconds[i] * 1e3
+         << "ms, closest hit " << closestSeconds / terrainRays.size() * 1e6
+         << "us per ray, any hit " << anySeconds / terrainRays.size() * 1e6
+         << "us per ray" << endl;
+  }
+
+  cout << "  grid has " << grid.cellCount() << " cells, "
+       << grid.referenceCount() << " references" << endl;
+}
+
+void Benchmark::layoutCost() {
+  const std::pair<const char *, BoundingVolume::Layout> layouts[] = {
+      {"binary:    ", BoundingVolume::Layout::Binary},
+      {"wide:      ", BoundingVolume::Layout::Wide},
+      {"compressed:", BoundingVolume::Layout::Compressed},
+      {"stackless: ", BoundingVolume::Layout::Stackless}};
+
+  BoundingVolume volume(triangles, BoundingVolume::BuildMode::Binned);
+
+  cout << "layout cost" << endl;
+
+  for (const auto &layout : layouts) {
+    volume.setLayout(layout.second);
+
+    auto start = std::chrono::steady_clock::now();
+    for (Ray ray : rays) {
+      volume.calculateIntersection(ray);
+    }
+    double closestSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+      volume.calculateAnyIntersection(ray);
+    }
+    double anySeconds = secondsSince(start);
+
+    cout << "  " << layout.first << " " << volume.nodeBytes() / 1024.0
+         << "KiB of nodes, closest hit " << closestSeconds / rays.size() * 1e6
+         << "us per ray, any hit " << anySeconds / rays.size() * 1e6
+         << "us per ray" << endl;
+  }
+}
+
+void Benchmark::orderCost(const BoundingVolume &volume) {
+  const std::pair<const char *, BoundingVolume::NodeOrder> orders[] = {
+      {"breadth first:", BoundingVolume::NodeOrder::BreadthFirst},
+      {"depth first:  ", BoundingVolume::NodeOrder::DepthFirst},
+      {"treelets:     ", BoundingVolume::NodeOrder::Treelets}};
+
+  cout << "node order cost" << endl;
+
+  for (const auto &order : orders) {
+    BoundingVolume ordered(volume);
+    ordered.setLayout(BoundingVolume::Layout::Binary);
+    ordered.reorder(order.second);
+
+    // one untimed pass, so that every order starts from a warm cache
+    for (Ray ray : rays) {
+      ordered.calculateIntersection(ray);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (Ray ray : rays) {
+      ordered.calculateIntersection(ray);
+    }
+    double seconds = secondsSince(start);
+
+    // sibling nodes fill two cache lines, which are fetched together
+    cout << "  " << order.first << " " << ordered.layoutCost(128)
+         << " line pairs and " << ordered.layoutCost(4096)
+         << " pages per ray, closest hit " << seconds / rays.size() * 1e6
+         << "us per ray" << endl;
+  }
+}
+
+vector<Ray> Benchmark::pixelRays(unsigned side) const {
+  // the width of a pixel seen from the camera, in radians
+  const float pixel = 1e-3f;
+
+  vector<Ray> packets;
+  packets.reserve(rays.size() * side * side);
+  for (const Ray &ray : rays) {
+    const vec3 direction = glm::normalize(ray.getDirection());
+    const vec3 across = glm::normalize(
+        glm::cross(direction, std::abs(direction.y) < 0.9f
+                                  ? vec3(0.0f, 1.0f, 0.0f)
+                                  : vec3(1.0f, 0.0f, 0.0f)));
+    const vec3 down = glm::cross(direction, across);
+    for (unsigned i = 0; i < side; i++) {
+      for (unsigned j = 0; j < side; j++) {
+        vec3 offset = pixel / side * (i * across + j * down);
+        packets.emplace_back(ray.getPosition(), direction + offset);
+      }
+    }
+  }
+  return packets;
+}
+
+void Benchmark::packetCost(const BoundingVolume &volume) {
+  const unsigned side = 4;
+  const unsigned packetSize = side * side;
+
+  vector<Ray> packets = pixelRays(side);
+
+  cout << "packets of " << packetSize << " rays" << endl;
+
+  vector<Ray> single(packets);
+  unsigned singleHits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (Ray &ray : single) {
+    singleHits += volume.calculateIntersection(ray);
+  }
+  double singleSeconds = secondsSince(start);
+
+  unsigned packetHits = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t first = 0; first < packets.size(); first += packetSize) {
+    uint64_t hits = volume.calculateIntersections(&packets[first], packetSize);
+    for (unsigned i = 0; i < packetSize; i++) {
+      packetHits += (hits >> i) & 1;
+    }
+  }
+  double packetSeconds = secondsSince(start);
+
+  cout << "  one at a time: " << singleSeconds / packets.size() * 1e6
+       << "us per ray, " << singleHits << " hits" << endl;
+  cout << "  packets:       " << packetSeconds / packets.size() * 1e6
+       << "us per ray, " << packetHits << " hits" << endl;
+}
+
+void Benchmark::shadowCost(const BoundingVolume &volume) {
+  // a light above the object, casting towards where each ray lands
+  const vec3 light = 0.5f * (bounds.a + bounds.b) +
+                     vec3(0.0f, 2.0f * (bounds.b.y - bounds.a.y), 0.0f);
+
+  vector<Ray> surfaces;
+  for (Ray ray : rays) {
+    if (volume.calculateIntersection(ray)) {
+      surfaces.push_back(ray);
+    }
+  }
+
+  cout << "shadow rays to " << surfaces.size() << " surfaces" << endl;
+
+  // finding the closest triangle to the light and checking it is the surface
+  unsigned lit = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray &surface : surfaces) {
+    vec3 target = surface.collisionLocation();
+    Ray lightRay(light, target - light);
+    lit += volume.calculateIntersection(lightRay) &&
+           lightRay.getCollision() == surface.getCollision();
+  }
+  double seconds = secondsSince(start);
+  cout << "  closest hit: " << seconds / surfaces.size() * 1e6
+       << "us per ray, " << 100.0 * lit / surfaces.size() << "% lit" << endl;
+
+  lit = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Ray &surface : surfaces) {
+    vec3 target = surface.collisionLocation();
+    Ray lightRay(light, target - light, glm::distance(light, target));
+    lit += glm::dot(surface.getCollision()->normal,
+                    lightRay.getDirection()) < 0.0f &&
+           !volume.calculateAnyIntersection(lightRay);
+  }
+  seconds = secondsSince(start);
+  cout << "  any hit:     " << seconds / surfaces.size() * 1e6
+       << "us per ray, " << 100.0 * lit / surfaces.size() << "% lit" << endl;
+}
+
+void Benchmark::frustumCost(const BoundingVolume &volume) {
+  const unsigned side = 4;
+  const unsigned packetSize = side * side;
+  const vec3 light = 0.5f * (bounds.a + bounds.b) +
+                     vec3(0.0f, 2.0f * (bounds.b.y - bounds.a.y), 0.0f);
+
+  // the rays from the light to every point a pixel's rays land on, packed
+  // together; surfaces facing away from the light are left out, as they are
+  // when lighting
+  vector<Ray> shadowRays;
+  vector<unsigned> packetStarts;
+  vector<Ray> cameraRays = pixelRays(side);
+  for (size_t first = 0; first < cameraRays.size(); first += packetSize) {
+    uint64_t hits = volume.calculateIntersections(&cameraRays[first],
+                                                  packetSize);
+    packetStarts.push_back(static_cast<unsigned>(shadowRays.size()));
+    for (unsigned i = 0; i < packetSize; i++) {
+      const Ray &surface = cameraRays[first + i];
+      if ((hits >> i) & 1) {
+        vec3 target = surface.collisionLocation();
+        Ray lightRay(light, target - light, glm::distance(light, target));
+        if (glm::dot(surface.getCollision()->normal,
+                     lightRay.getDirection()) < 0.0f) {
+          shadowRays.push_back(lightRay);
+        }
+      }
+    }
+  }
+  packetStarts.push_back(static_cast<unsigned>(shadowRays.size()));
+
+  cout << "shadow frustums of up to " << packetSize << " rays" << endl;
+
+  unsigned singleLit = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray &lightRay : shadowRays) {
+    singleLit += !volume.calculateAnyIntersection(lightRay);
+  }
+  double singleSeconds = secondsSince(start);
+
+  unsigned frustumLit = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t packet = 0; packet + 1 < packetStarts.size(); packet++) {
+    const unsigned first = packetStarts[packet];
+    const unsigned count = packetStarts[packet + 1] - first;
+    uint64_t blocked =
+        volume.calculateAnyIntersections(&shadowRays[first], count);
+    for (unsigned i = 0; i < count; i++) {
+      frustumLit += !((blocked >> i) & 1);
+    }
+  }
+  double frustumSeconds = secondsSince(start);
+
+  cout << "  one at a time: " << singleSeconds / shadowRays.size() * 1e6
+       << "us per ray, " << singleLit << " lit" << endl;
+  cout << "  frustums:      " << frustumSeconds / shadowRays.size() * 1e6
+       << "us per ray, " << frustumLit << " lit" << endl;
+}
+
+void Benchmark::proxyCost(const BoundingVolume &volume) {
+  auto start = std::chrono::steady_clock::now();
+  ProxyVolume proxy(triangles);
+  double buildSeconds = secondsSince(start);
+
+  cout << "proxy of " << proxy.getTriangles().size() << " triangles, built in "
+       << buildSeconds * 1e3 << "ms" << endl;
+
+  vector<bool> fullHits;
+  start = std::chrono::steady_clock::now();
+  for (Ray ray : rays) {
+    fullHits.push_back(volume.calculateIntersection(ray));
+  }
+  double fullSeconds = secondsSince(start);
+
+  unsigned agreed = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rays.size(); i++) {
+    Ray ray = rays[i];
+    agreed += proxy.calculateIntersection(ray) == fullHits[i];
+  }
+  double proxySeconds = secondsSince(start);
+
+  cout << "  full:  " << fullSeconds / rays.size() * 1e6 << "us per ray"
+       << endl;
+  cout << "  proxy: " << proxySeconds / rays.size() * 1e6 << "us per ray, "
+       << 100.0 * agreed / rays.size() << "% agreeing" << endl;
+}
+
+void Benchmark::instanceCost(const BoundingVolume &volume) {
+  const unsigned size = 10;
+
+  auto start = std::chrono::steady_clock::now();
+  TopLevelVolume copies(TopLevelVolume::grid(volume, bounds, size));
+  double buildSeconds = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  copies.moveInstance(0, mat3(1.0f), vec3());
+  double moveSeconds = secondsSince(start);
+
+  vector<Ray> gridRays = raysInto(copies.getBounds(), rays.size());
+  unsigned hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (Ray ray : gridRays) {
+    hits += copies.calculateIntersection(ray);
+  }
+  double traceSeconds = secondsSince(start);
+
+  size_t count = copies.getInstances().size();
+  cout << count << " instances" << endl;
+  cout << "  top level built in " << buildSeconds * 1e3 << "ms, rebuilt in "
+       << moveSeconds * 1e3 << "ms after a move" << endl;
+  cout << "  " << traceSeconds / gridRays.size() * 1e6 << "us per ray, "
+       << 100.0 * hits / gridRays.size() << "% hit" << endl;
+  cout << "  " << triangles.size() << " triangles shared rather than "
+       << count * triangles.size() << endl;
+}
+
+void Benchmark::run(const BoundingVolume &volume) {
+  cout << "benchmarking " << triangles.size() << " triangles" << endl;
+
+  printStatistics(volume);
+  buildCost();
+  layoutCost();
+  orderCost(volume);
+  backendCost();
+  gridCost();
+  nodeCost(volume);
+  triangleCost();
+  packetCost(volume);
+  shadowCost(volume);
+  frustumCost(volume);
+  proxyCost(volume);
+  instanceCost(volume);
+}
@@ -1,133 +1,2468 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <omp.h>
+#include <unordered_map>
+
+#ifdef unix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "bvh.h"
 
-BoundingVolume::BoundingVolume(const Ptr_Triangles &triangles)
-    : triangles(triangles) {
+// OpenMP tasks arrived in version 3.0, so older implementations such as
+// Visual C++'s build the hierarchy on one thread
+#if defined(_OPENMP) && _OPENMP >= 200805
+#define OMP_TASKS
+#endif
+
+const vec3 BoundingVolume::normals[7] = {
+    vec3(1, 0, 0),       vec3(0, 1, 0),        vec3(0, 0, 1),
+    vec3(1, 1, 1) * R3,  vec3(-1, 1, 1) * R3,  vec3(-1, -1, 1) * R3,
+    vec3(1, -1, 1) * R3};
+
+// axis aligned box and centroid of one reference to a triangle, used while
+// building; the box of a triangle cut by spatial splits bounds only its part
+struct BuildTriangle {
+  Ptr_Triangle triangle;
+  vec3 min, max, centroid;
+  bool clipped;
+};
+
+static float surfaceArea(vec3 min, vec3 max) {
+  vec3 extent = max - min;
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z +
+                 extent.z * extent.x);
+}
+
+// area of the axis aligned part of a node, the first three slabs
+static float surfaceArea(const BoundingVolume::Node &node) {
+  return surfaceArea(vec3(node.d[0][0], node.d[0][1], node.d[0][2]),
+                     vec3(node.d[1][0], node.d[1][1], node.d[1][2]));
+}
+
+// reciprocal that stays finite for rays parallel to a slab, so that slab
+// distances never become NaN under fast math
+static float reciprocal(float x) {
+  const float minimum = 1e-20f;
+  if (std::abs(x) < minimum) {
+    x = (x < 0.0f) ? -minimum : minimum;
+  }
+  return 1.0f / x;
+}
+
+static void sortByAxis(BuildTriangle *begin, BuildTriangle *end, int axis) {
+  std::sort(begin, end,
+            [axis](const BuildTriangle &a, const BuildTriangle &b) {
+              return a.centroid[axis] < b.centroid[axis];
+            });
+}
+
+// clips a triangle to a box, writing the corners of the polygon that remains
+// and returning how many there are; an edge crossing a plane is always
+// interpolated from its lower end, so that the two sides of a cut share the
+// same corners exactly
+static int clipTriangle(const Triangle &triangle, vec3 min, vec3 max,
+                        vec3 polygon[9]) {
+  vec3 buffer[9];
+  vec3 *in = polygon;
+  vec3 *out = buffer;
+  in[0] = triangle.v0;
+  in[1] = triangle.v1;
+  in[2] = triangle.v2;
+  int count = 3;
+
+  for (int plane = 0; plane < 6 && count > 0; plane++) {
+    const int axis = plane % 3;
+    const bool keepBelow = plane >= 3;
+    const float bound = keepBelow ? max[axis] : min[axis];
+
+    int outCount = 0;
+    for (int i = 0; i < count; i++) {
+      vec3 a = in[i];
+      vec3 b = in[(i + 1) % count];
+      bool aInside = keepBelow ? a[axis] <= bound : a[axis] >= bound;
+      bool bInside = keepBelow ? b[axis] <= bound : b[axis] >= bound;
+
+      if (aInside) {
+        out[outCount++] = a;
+      }
+      if (aInside != bInside) {
+        vec3 low = (a[axis] < b[axis]) ? a : b;
+        vec3 high = (a[axis] < b[axis]) ? b : a;
+        float t = (bound - low[axis]) / (high[axis] - low[axis]);
+        vec3 crossing = low + t * (high - low);
+        crossing[axis] = bound;
+        out[outCount++] = crossing;
+      }
+    }
+
+    std::swap(in, out);
+    count = outCount;
+  }
+
+  if (in != polygon) {
+    std::copy(in, in + count, polygon);
+  }
+  return count;
+}
+
+// the points whose slab distances bound a reference: the corners of the
+// triangle, or of the part of it inside the reference's box
+static int referencePoints(const BuildTriangle &reference, vec3 points[9]) {
+  const Triangle &triangle = *reference.triangle;
+  if (!reference.clipped) {
+    points[0] = triangle.v0;
+    points[1] = triangle.v1;
+    points[2] = triangle.v2;
+    return 3;
+  }
+
+  int count = clipTriangle(triangle, reference.min, reference.max, points);
+  if (count == 0) {
+    // the triangle only grazes the box, which still bounds it
+    for (int i = 0; i < 8; i++) {
+      points[i] = vec3((i & 1) ? reference.max.x : reference.min.x,
+                       (i & 2) ? reference.max.y : reference.min.y,
+                       (i & 4) ? reference.max.z : reference.min.z);
+    }
+    count = 8;
+  }
+  return count;
+}
+
+// fits the slabs of a leaf around the references in [begin, end)
+static void fitLeaf(BoundingVolume::Node &node, const BuildTriangle *begin,
+                    const BuildTriangle *end) {
+  for (int i = 0; i < 7; i++) {
+    node.d[0][i] = numeric_limits<float>::max();
+    node.d[1][i] = -numeric_limits<float>::max();
+  }
+  for (const BuildTriangle *it = begin; it != end; ++it) {
+    vec3 points[9];
+    int pointCount = referencePoints(*it, points);
+    for (int j = 0; j < pointCount; j++) {
+      for (int i = 0; i < 7; i++) {
+        float D = glm::dot(BoundingVolume::normals[i], points[j]);
+        node.d[0][i] = std::min(node.d[0][i], D);
+        node.d[1][i] = std::max(node.d[1][i], D);
+      }
+    }
+  }
+}
+
+static void fitParent(BoundingVolume::Node &parent,
+                      const BoundingVolume::Node &first,
+                      const BoundingVolume::Node &second) {
+  for (int i = 0; i < 7; i++) {
+    parent.d[0][i] = std::min(first.d[0][i], second.d[0][i]);
+    parent.d[1][i] = std::max(first.d[1][i], second.d[1][i]);
+  }
+}
+
+// narrows a reference to the part of its triangle inside the box
+static BuildTriangle clipReference(const BuildTriangle &reference, vec3 min,
+                                   vec3 max) {
+  min = glm::max(min, reference.min);
+  max = glm::min(max, reference.max);
+
+  vec3 polygon[9];
+  int count = clipTriangle(*reference.triangle, min, max, polygon);
+  if (count > 0) {
+    vec3 clippedMin = polygon[0];
+    vec3 clippedMax = polygon[0];
+    for (int i = 1; i < count; i++) {
+      clippedMin = glm::min(clippedMin, polygon[i]);
+      clippedMax = glm::max(clippedMax, polygon[i]);
+    }
+    min = glm::max(min, clippedMin);
+    max = glm::min(max, clippedMax);
+  }
+
+  return {reference.triangle, min, max, 0.5f * (min + max), true};
+}
+
+BoundingVolume::BoundingVolume(const Ptr_Triangles &triangles, BuildMode mode,
+                               unsigned leafSize)
+    : layout(Layout::Binary), buildMode(mode), leafSize(leafSize) {
+  build(triangles);
+  packed = PackedTriangles(this->triangles);
+  builtCost = sahCost();
+}
+
+BoundingVolume::BoundingVolume(const Ptr_Triangles &triangles,
+                               const std::string &cacheName, BuildMode mode,
+                               unsigned leafSize)
+    : layout(Layout::Binary), buildMode(mode), leafSize(leafSize) {
+  if (!readCache(cacheName, triangles)) {
+    build(triangles);
+    writeCache(cacheName, triangles);
+  }
+  packed = PackedTriangles(this->triangles);
+  builtCost = sahCost();
+}
+
+// the start of a cache file, which is followed by the nodes and then by the
+// index of each leaf triangle among the triangles the hierarchy was built
+// over; everything is stored as it is in memory, so a cache is only meant to
+// be read on the kind of machine that wrote it
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t hash;
+  uint32_t mode;
+  uint32_t leafSize;
+  uint32_t triangleCount;
+  uint32_t nodeCount;
+  uint32_t referenceCount;
+};
+
+static const char CACHE_MAGIC[4] = {'B', 'V', 'H', '7'};
+
+// 64 bit FNV-1a over every vertex position, in order
+uint64_t BoundingVolume::hashTriangles(const Ptr_Triangles &triangles) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const Ptr_Triangle &triangle : triangles) {
+    for (const vec3 &vertex : {triangle->v0, triangle->v1, triangle->v2}) {
+      const float position[3] = {vertex.x, vertex.y, vertex.z};
+      const unsigned char *bytes =
+          reinterpret_cast<const unsigned char *>(position);
+      for (size_t i = 0; i < sizeof(position); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+      }
+    }
+  }
+  return hash;
+}
+
+// maps the file into memory where the platform allows, rather than copying it
+// through a buffer
+bool BoundingVolume::readCache(const std::string &fileName,
+                               const Ptr_Triangles &triangles) {
+#ifdef unix
+  int file = open(fileName.c_str(), O_RDONLY);
+  if (file == -1) {
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(file, &status) != 0 || status.st_size == 0) {
+    close(file);
+    return false;
+  }
+
+  const size_t size = static_cast<size_t>(status.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  bool valid = parseCache(static_cast<const char *>(mapping), size, triangles);
+  munmap(mapping, size);
+#else
+  FILE *file = fopen(fileName.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  vector<char> contents;
+  char buffer[1 << 16];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+    contents.insert(contents.end(), buffer, buffer + read);
+  }
+  fclose(file);
+
+  bool valid = parseCache(contents.data(), contents.size(), triangles);
+#endif
+
+  if (!valid) {
+    nodes.clear();
+    this->triangles.clear();
+  }
+  return valid;
+}
+
+// a cache is only used if it was built over the same triangles in the same
+// way, and every node refers to something inside the cache
+bool BoundingVolume::parseCache(const char *data, size_t size,
+                                const Ptr_Triangles &triangles) {
+  CacheHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header.version != CACHE_VERSION ||
+      header.mode != static_cast<uint32_t>(buildMode) ||
+      header.leafSize != leafSize || header.triangleCount != triangles.size() ||
+      header.hash != hashTriangles(triangles)) {
+    return false;
+  }
+
+  const size_t nodeBytes = header.nodeCount * sizeof(Node);
+  const size_t indexBytes = header.referenceCount * sizeof(uint32_t);
+  if (size != sizeof(header) + nodeBytes + indexBytes) {
+    return false;
+  }
+
+  nodes.resize(header.nodeCount);
+  std::memcpy(nodes.data(), data + sizeof(header), nodeBytes);
+  for (unsigned index = 0; index < header.nodeCount; index++) {
+    const Node &node = nodes[index];
+    if (node.isLeaf() ? node.offset + node.count > header.referenceCount
+                      : node.offset <= index ||
+                            node.offset + 1 >= header.nodeCount) {
+      return false;
+    }
+  }
+
+  const char *indices = data + sizeof(header) + nodeBytes;
+  this->triangles.reserve(header.referenceCount);
+  for (unsigned i = 0; i < header.referenceCount; i++) {
+    uint32_t index;
+    std::memcpy(&index, indices + i * sizeof(index), sizeof(index));
+    if (index >= triangles.size()) {
+      return false;
+    }
+    this->triangles.push_back(triangles[index]);
+  }
+
+  return true;
+}
+
+// written beside the cache and then renamed over it, so that a reader never
+// sees half a file
+void BoundingVolume::writeCache(const std::string &fileName,
+                                const Ptr_Triangles &triangles) const {
+  std::unordered_map<Ptr_Triangle, uint32_t> indices;
+  for (size_t i = 0; i < triangles.size(); i++) {
+    indices.emplace(triangles[i], static_cast<uint32_t>(i));
+  }
+  vector<uint32_t> references;
+  references.reserve(this->triangles.size());
+  for (const Ptr_Triangle &triangle : this->triangles) {
+    references.push_back(indices[triangle]);
+  }
+
+  CacheHeader header = {};
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.hash = hashTriangles(triangles);
+  header.mode = static_cast<uint32_t>(buildMode);
+  header.leafSize = leafSize;
+  header.triangleCount = static_cast<uint32_t>(triangles.size());
+  header.nodeCount = static_cast<uint32_t>(nodes.size());
+  header.referenceCount = static_cast<uint32_t>(references.size());
+
+  const std::string temporaryName = fileName + ".tmp";
+  FILE *file = fopen(temporaryName.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Could not write \"" << fileName << "\"" << std::endl;
+    return;
+  }
+
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size() &&
+      fwrite(references.data(), sizeof(uint32_t), references.size(), file) ==
+          references.size();
+  written = (fclose(file) == 0) && written;
+
+#ifndef unix
+  // renaming over an existing file fails on Windows
+  std::remove(fileName.c_str());
+#endif
+  if (!written || std::rename(temporaryName.c_str(), fileName.c_str()) != 0) {
+    std::cerr << "Could not write \"" << fileName << "\"" << std::endl;
+    std::remove(temporaryName.c_str());
+  }
+}
+
+void BoundingVolume::build(const Ptr_Triangles &triangles) {
+  if (triangles.empty()) {
+    return;
+  }
+
+  const int triangleCount = static_cast<int>(triangles.size());
+  vector<BuildTriangle> buildTriangles(triangleCount);
+#pragma omp parallel for
+  for (int i = 0; i < triangleCount; i++) {
+    const Triangle &triangle = *triangles[i];
+    buildTriangles[i] = {&triangle,
+                         glm::min(glm::min(triangle.v0, triangle.v1),
+                                  triangle.v2),
+                         glm::max(glm::max(triangle.v0, triangle.v1),
+                                  triangle.v2),
+                         (triangle.v0 + triangle.v1 + triangle.v2) / 3.0f,
+                         false};
+  }
+
+  BuildTriangle *begin = buildTriangles.data();
+  BuildTriangle *end = begin + buildTriangles.size();
+
+  if (buildMode == BuildMode::Binned || buildMode == BuildMode::Morton) {
+    // a binary tree with a triangle or more in every leaf has fewer than
+    // twice as many nodes as triangles, so the array never grows and
+    // subtrees can be built at the same time
+    nodes.resize(2 * triangles.size() - 1);
+    std::atomic<unsigned> nodeCount(1);
+
+    if (buildMode == BuildMode::Morton) {
+      vector<unsigned> codes = sortByMortonCode(buildTriangles);
+      begin = buildTriangles.data();
+      end = begin + buildTriangles.size();
+#pragma omp parallel
+#pragma omp single
+      buildMorton(0, begin, end, codes.data(), begin, leafSize, &nodeCount);
+    } else {
+#pragma omp parallel
+#pragma omp single
+      buildBinned(0, begin, end, begin, leafSize, 0, &nodeCount);
+    }
+    nodes.resize(nodeCount);
+
+    this->triangles.reserve(triangles.size());
+    for (const BuildTriangle &buildTriangle : buildTriangles) {
+      this->triangles.push_back(buildTriangle.triangle);
+    }
+    reorder(NodeOrder::Treelets);
+    return;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 rootMin(maxFloat, maxFloat, maxFloat);
+  vec3 rootMax(-maxFloat, -maxFloat, -maxFloat);
+  for (const BuildTriangle &buildTriangle : buildTriangles) {
+    rootMin = glm::min(rootMin, buildTriangle.min);
+    rootMax = glm::max(rootMax, buildTriangle.max);
+  }
+
+  this->triangles.reserve(triangles.size());
+  nodes.reserve(2 * triangles.size());
+  nodes.resize(1);
+
+  BuildSettings settings = {buildMode, leafSize, surfaceArea(rootMin, rootMax),
+                            SPATIAL_BUDGET * triangles.size()};
+
+  buildSub(0, begin, end, settings, 0);
+  reorder(NodeOrder::Treelets);
+}
+
+// fills in the node at index for the triangles in [begin, end), appending its
+// children as a pair to the end of the node array
+void BoundingVolume::buildSub(unsigned index, BuildTriangle *begin,
+                              BuildTriangle *end, BuildSettings &settings,
+                              unsigned depth) {
+  float cost;
+  size_t split = findSplit(begin, end, settings.leafSize, depth, cost);
+
+  // references to triangles cut in two, when a spatial split is cheaper than
+  // the object split found, or than a leaf when no object split paid off
+  vector<BuildTriangle> references;
+  size_t leftCount = 0;
+
+  if (settings.mode == BuildMode::Spatial && depth < MAX_SAH_DEPTH &&
+      static_cast<size_t>(end - begin) > settings.leafSize &&
+      settings.splitBudget > 0) {
+    // a spatial split can only help where the object split's children overlap
+    float overlap = settings.rootArea;
+    if (split != 0) {
+      float maxFloat = numeric_limits<float>::max();
+      vec3 leftMin(maxFloat, maxFloat, maxFloat), rightMin = leftMin;
+      vec3 leftMax = -leftMin, rightMax = -leftMin;
+      for (const BuildTriangle *it = begin; it != begin + split; ++it) {
+        leftMin = glm::min(leftMin, it->min);
+        leftMax = glm::max(leftMax, it->max);
+      }
+      for (const BuildTriangle *it = begin + split; it != end; ++it) {
+        rightMin = glm::min(rightMin, it->min);
+        rightMax = glm::max(rightMax, it->max);
+      }
+      vec3 overlapMin = glm::max(leftMin, rightMin);
+      vec3 overlapMax = glm::min(leftMax, rightMax);
+      overlap = (overlapMin.x < overlapMax.x && overlapMin.y < overlapMax.y &&
+                 overlapMin.z < overlapMax.z)
+                    ? surfaceArea(overlapMin, overlapMax)
+                    : 0.0f;
+    }
+
+    int axis;
+    float position;
+    if (overlap > SPATIAL_OVERLAP * settings.rootArea &&
+        findSpatialSplit(begin, end, axis, position) < cost) {
+      leftCount = spatialSplit(begin, end, axis, position, references);
+
+      // binning rounds positions, so the plane may not divide the references
+      if (leftCount == 0 || leftCount == references.size()) {
+        references.clear();
+      } else {
+        const size_t added = references.size() - (end - begin);
+        settings.splitBudget -= std::min(settings.splitBudget, added);
+      }
+    }
+  }
+
+  if (split == 0 && references.empty()) {
+    nodes[index].offset = static_cast<unsigned>(triangles.size());
+    nodes[index].count = static_cast<unsigned>(end - begin);
+    fitLeaf(nodes[index], begin, end);
+    for (const BuildTriangle *it = begin; it != end; ++it) {
+      triangles.push_back(it->triangle);
+    }
+    return;
+  }
+
+  BuildTriangle *middle = begin + split;
+  if (!references.empty()) {
+    // the left child's references come first, followed by the right's
+    begin = references.data();
+    end = begin + references.size();
+    middle = begin + leftCount;
+  }
+
+  // the array may grow while building the children, so nodes are looked up
+  // by index rather than held by reference
+  const unsigned child = static_cast<unsigned>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  nodes[index].offset = child;
+  nodes[index].count = 0;
+
+  buildSub(child, begin, middle, settings, depth + 1);
+  buildSub(child + 1, middle, end, settings, depth + 1);
+
+  fitParent(nodes[index], nodes[child], nodes[child + 1]);
+}
+
+// sorts [begin, end) along the cheapest axis and returns the number of
+// triangles in the first child, or zero if the range should become a leaf;
+// each side of a split costs its triangle count weighted by the chance that a
+// ray through the parent also passes through that side, and the cost of the
+// choice made is returned through cost
+size_t BoundingVolume::findSplit(BuildTriangle *begin, BuildTriangle *end,
+                                 unsigned leafSize, unsigned depth,
+                                 float &cost) {
+  const size_t count = end - begin;
+  cost = static_cast<float>(count);
+  if (count <= leafSize) {
+    return 0;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 parentMin(maxFloat, maxFloat, maxFloat);
+  vec3 parentMax(-maxFloat, -maxFloat, -maxFloat);
+  for (const BuildTriangle *it = begin; it != end; ++it) {
+    parentMin = glm::min(parentMin, it->min);
+    parentMax = glm::max(parentMax, it->max);
+  }
+  float parentArea = surfaceArea(parentMin, parentMax);
+
+  float bestCost = static_cast<float>(count);
+  int bestAxis = -1;
+  size_t bestSplit = count / 2;
+
+  vector<float> rightArea(count);
+  for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++) {
+    sortByAxis(begin, end, axis);
+
+    vec3 min(maxFloat, maxFloat, maxFloat);
+    vec3 max(-maxFloat, -maxFloat, -maxFloat);
+    for (size_t i = count - 1; i > 0; i--) {
+      min = glm::min(min, begin[i].min);
+      max = glm::max(max, begin[i].max);
+      rightArea[i] = surfaceArea(min, max);
+    }
+
+    min = vec3(maxFloat, maxFloat, maxFloat);
+    max = vec3(-maxFloat, -maxFloat, -maxFloat);
+    for (size_t i = 1; i < count; i++) {
+      min = glm::min(min, begin[i - 1].min);
+      max = glm::max(max, begin[i - 1].max);
+      float splitCost =
+          TRAVERSAL_COST +
+          (surfaceArea(min, max) * i + rightArea[i] * (count - i)) /
+              parentArea;
+      if (splitCost < bestCost) {
+        bestCost = splitCost;
+        bestAxis = axis;
+        bestSplit = i;
+      }
+    }
+  }
+
+  if (bestAxis == -1) {
+    if (count <= MAX_LEAF_SIZE) {
+      return 0;
+    }
+    // no split pays for itself but the leaf would be too big, so fall back to
+    // a median split along the longest axis
+    vec3 extent = parentMax - parentMin;
+    bestAxis = (extent.x > extent.y && extent.x > extent.z)
+                   ? 0
+                   : (extent.y > extent.z ? 1 : 2);
+    bestSplit = count / 2;
+  } else {
+    cost = bestCost;
+  }
+
+  sortByAxis(begin, end, bestAxis);
+
+  return bestSplit;
+}
+
+// fills in the node at index for the triangles in [begin, end), which are
+// reordered in place so that each leaf refers to a contiguous range of them;
+// pairs of children are claimed from the preallocated node array, and large
+// subtrees are built as separate tasks
+void BoundingVolume::buildBinned(unsigned index, BuildTriangle *begin,
+                                 BuildTriangle *end, const BuildTriangle *first,
+                                 unsigned leafSize, unsigned depth,
+                                 std::atomic<unsigned> *nodeCount) {
+  size_t split = findBinnedSplit(begin, end, leafSize, depth);
+
+  if (split == 0) {
+    nodes[index].offset = static_cast<unsigned>(begin - first);
+    nodes[index].count = static_cast<unsigned>(end - begin);
+    fitLeaf(nodes[index], begin, end);
+    return;
+  }
+
+  const unsigned child = nodeCount->fetch_add(2);
+  nodes[index].offset = child;
+  nodes[index].count = 0;
+
+  BuildTriangle *middle = begin + split;
+#ifdef OMP_TASKS
+#pragma omp task if (split > TASK_SIZE)
+#endif
+  buildBinned(child, begin, middle, first, leafSize, depth + 1, nodeCount);
+  buildBinned(child + 1, middle, end, first, leafSize, depth + 1, nodeCount);
+#ifdef OMP_TASKS
+#pragma omp taskwait
+#endif
+
+  fitParent(nodes[index], nodes[child], nodes[child + 1]);
+}
+
+// spreads the low ten bits of x out to every third bit
+static unsigned expandBits(unsigned x) {
+  x = (x * 0x00010001u) & 0xFF0000FFu;
+  x = (x * 0x00000101u) & 0x0F00F00Fu;
+  x = (x * 0x00000011u) & 0xC30C30C3u;
+  x = (x * 0x00000005u) & 0x49249249u;
+  return x;
+}
+
+// a code for each triangle and the position it came from
+struct MortonTriangle {
+  unsigned code;
+  unsigned index;
+};
+
+// sorts by code eight bits at a time, least significant first; each thread
+// counts the digits in its own part of the input, which tells it where to
+// scatter that part without waiting on the others, and keeps the sort stable
+static void radixSort(vector<MortonTriangle> &items) {
+  const int count = static_cast<int>(items.size());
+  vector<MortonTriangle> buffer(items.size());
+  vector<unsigned> offsets;
+
+  for (int shift = 0; shift < 32; shift += 8) {
+#pragma omp parallel
+    {
+      const int threads = omp_get_num_threads();
+      const int thread = omp_get_thread_num();
+      const int begin = static_cast<int>(static_cast<long long>(count) *
+                                         thread / threads);
+      const int end = static_cast<int>(static_cast<long long>(count) *
+                                       (thread + 1) / threads);
+
+#pragma omp single
+      offsets.assign(256 * threads, 0);
+
+      for (int i = begin; i < end; i++) {
+        offsets[((items[i].code >> shift) & 0xFF) * threads + thread]++;
+      }
+#pragma omp barrier
+
+      // ordered by digit and then by thread, the counts become the position
+      // of each thread's first item with each digit
+#pragma omp single
+      {
+        unsigned total = 0;
+        for (unsigned &offset : offsets) {
+          unsigned digitCount = offset;
+          offset = total;
+          total += digitCount;
+        }
+      }
+
+      for (int i = begin; i < end; i++) {
+        unsigned &offset =
+            offsets[((items[i].code >> shift) & 0xFF) * threads + thread];
+        buffer[offset++] = items[i];
+      }
+    }
+
+    items.swap(buffer);
+  }
+}
+
+// reorders the triangles along a Z-order curve through their centroids and
+// returns the code of each, so that triangles close together in space are
+// close together in the array
+vector<unsigned>
+BoundingVolume::sortByMortonCode(vector<BuildTriangle> &buildTriangles) {
+  const int count = static_cast<int>(buildTriangles.size());
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 min(maxFloat, maxFloat, maxFloat);
+  vec3 max(-maxFloat, -maxFloat, -maxFloat);
+  for (const BuildTriangle &buildTriangle : buildTriangles) {
+    min = glm::min(min, buildTriangle.centroid);
+    max = glm::max(max, buildTriangle.centroid);
+  }
+
+  // centroids are quantised to ten bits along each axis
+  vec3 scale;
+  for (int axis = 0; axis < 3; axis++) {
+    scale[axis] = (max[axis] > min[axis]) ? 1023.0f / (max[axis] - min[axis])
+                                          : 0.0f;
+  }
+
+  vector<MortonTriangle> items(count);
+#pragma omp parallel for
+  for (int i = 0; i < count; i++) {
+    vec3 cell = (buildTriangles[i].centroid - min) * scale;
+    items[i] = {(expandBits(static_cast<unsigned>(cell.x)) << 2) |
+                    (expandBits(static_cast<unsigned>(cell.y)) << 1) |
+                    expandBits(static_cast<unsigned>(cell.z)),
+                static_cast<unsigned>(i)};
+  }
+
+  radixSort(items);
+
+  vector<BuildTriangle> sorted(count);
+  vector<unsigned> codes(count);
+#pragma omp parallel for
+  for (int i = 0; i < count; i++) {
+    sorted[i] = buildTriangles[items[i].index];
+    codes[i] = items[i].code;
+  }
+  buildTriangles.swap(sorted);
+
+  return codes;
+}
+
+// fills in the node at index for the triangles in [begin, end), already
+// sorted by their Morton codes; each node splits where the highest bit that
+// differs across its range changes, so no costs are evaluated and each
+// subtree can be built as a separate task
+void BoundingVolume::buildMorton(unsigned index, BuildTriangle *begin,
+                                 BuildTriangle *end, const unsigned *codes,
+                                 const BuildTriangle *first, unsigned leafSize,
+                                 std::atomic<unsigned> *nodeCount) {
+  const size_t count = end - begin;
+
+  if (count <= leafSize) {
+    nodes[index].offset = static_cast<unsigned>(begin - first);
+    nodes[index].count = static_cast<unsigned>(count);
+    fitLeaf(nodes[index], begin, end);
+    return;
+  }
+
+  const unsigned *beginCode = codes + (begin - first);
+  const unsigned *endCode = beginCode + count;
+
+  size_t split = count / 2;
+  unsigned differentBits = *beginCode ^ *(endCode - 1);
+  if (differentBits != 0) {
+    // keep only the highest of the bits
+    for (int shift = 1; shift < 32; shift *= 2) {
+      differentBits |= differentBits >> shift;
+    }
+    const unsigned bit = differentBits ^ (differentBits >> 1);
+
+    split = std::partition_point(beginCode, endCode,
+                                 [bit](unsigned code) {
+                                   return (code & bit) == 0;
+                                 }) -
+            beginCode;
+  }
+
+  const unsigned child = nodeCount->fetch_add(2);
+  nodes[index].offset = child;
+  nodes[index].count = 0;
+
+  BuildTriangle *middle = begin + split;
+#ifdef OMP_TASKS
+#pragma omp task if (split > TASK_SIZE)
+#endif
+  buildMorton(child, begin, middle, codes, first, leafSize, nodeCount);
+  buildMorton(child + 1, middle, end, codes, first, leafSize, nodeCount);
+#ifdef OMP_TASKS
+#pragma omp taskwait
+#endif
+
+  fitParent(nodes[index], nodes[child], nodes[child + 1]);
+}
+
+// calls work(chunk, begin, end) on each of chunkCount equal parts of
+// [begin, end), each as a separate task when there is more than one
+template <typename Work>
+static void forEachChunk(const BuildTriangle *begin, const BuildTriangle *end,
+                         size_t chunkCount, const Work &work) {
+  const size_t count = end - begin;
+  for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+    const BuildTriangle *chunkBegin = begin + chunk * count / chunkCount;
+    const BuildTriangle *chunkEnd = begin + (chunk + 1) * count / chunkCount;
+#ifdef OMP_TASKS
+#pragma omp task if (chunkCount > 1) shared(work)
+#endif
+    work(chunk, chunkBegin, chunkEnd);
+  }
+#ifdef OMP_TASKS
+#pragma omp taskwait
+#endif
+}
+
+// sorts the centroids in [begin, end) into bins along each axis, evaluates
+// the surface area heuristic at the boundaries between bins, and partitions
+// the range at the cheapest one; returns the number of triangles in the
+// first child, or zero if the range should become a leaf
+size_t BoundingVolume::findBinnedSplit(BuildTriangle *begin,
+                                       BuildTriangle *end, unsigned leafSize,
+                                       unsigned depth) {
+  const size_t count = end - begin;
+  if (count <= leafSize) {
+    return 0;
+  }
+
+  struct Bin {
+    vec3 min, max;
+    unsigned count;
+  };
+  const float maxFloat = numeric_limits<float>::max();
+  const Bin emptyBin = {vec3(maxFloat, maxFloat, maxFloat),
+                        vec3(-maxFloat, -maxFloat, -maxFloat), 0};
+
+  // the bounds of the triangles and of their centroids, in parallel for
+  // large ranges
+  const size_t chunkCount =
+      std::min<size_t>(count / TASK_SIZE + 1, MAX_CHUNKS);
+  Bin bounds[MAX_CHUNKS];
+  Bin centroidBounds[MAX_CHUNKS];
+  std::fill(bounds, bounds + chunkCount, emptyBin);
+  std::fill(centroidBounds, centroidBounds + chunkCount, emptyBin);
+  forEachChunk(begin, end, chunkCount,
+               [&](size_t chunk, const BuildTriangle *chunkBegin,
+                   const BuildTriangle *chunkEnd) {
+                 for (const BuildTriangle *it = chunkBegin; it != chunkEnd;
+                      ++it) {
+                   bounds[chunk].min = glm::min(bounds[chunk].min, it->min);
+                   bounds[chunk].max = glm::max(bounds[chunk].max, it->max);
+                   centroidBounds[chunk].min =
+                       glm::min(centroidBounds[chunk].min, it->centroid);
+                   centroidBounds[chunk].max =
+                       glm::max(centroidBounds[chunk].max, it->centroid);
+                 }
+               });
+
+  Bin parent = emptyBin;
+  Bin centroids = emptyBin;
+  for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+    parent.min = glm::min(parent.min, bounds[chunk].min);
+    parent.max = glm::max(parent.max, bounds[chunk].max);
+    centroids.min = glm::min(centroids.min, centroidBounds[chunk].min);
+    centroids.max = glm::max(centroids.max, centroidBounds[chunk].max);
+  }
+  const float parentArea = surfaceArea(parent.min, parent.max);
+  const vec3 centroidExtent = centroids.max - centroids.min;
+
+  // bins index centroids from zero at the low end to just under BINS at the
+  // high end, so that none falls out of range
+  vec3 scale;
+  for (int axis = 0; axis < 3; axis++) {
+    scale[axis] = (centroidExtent[axis] > 0.0f)
+                      ? BINS * (1.0f - 1e-5f) / centroidExtent[axis]
+                      : 0.0f;
+  }
+  auto binOf = [&](const BuildTriangle &buildTriangle, int axis) {
+    int bin = static_cast<int>((buildTriangle.centroid[axis] -
+                                centroids.min[axis]) *
+                               scale[axis]);
+    return std::min(std::max(bin, 0), static_cast<int>(BINS) - 1);
+  };
+
+  float bestCost = static_cast<float>(count);
+  int bestAxis = -1;
+  int bestBin = 0;
+
+  if (depth < MAX_SAH_DEPTH) {
+    // only ranges split into several chunks need the bins on the heap
+    Bin localBins[3 * BINS];
+    vector<Bin> sharedBins;
+    Bin *chunkBins = localBins;
+    if (chunkCount > 1) {
+      sharedBins.resize(chunkCount * 3 * BINS);
+      chunkBins = sharedBins.data();
+    }
+    std::fill(chunkBins, chunkBins + chunkCount * 3 * BINS, emptyBin);
+    forEachChunk(begin, end, chunkCount,
+                 [&](size_t chunk, const BuildTriangle *chunkBegin,
+                     const BuildTriangle *chunkEnd) {
+                   Bin *bins = &chunkBins[chunk * 3 * BINS];
+                   for (const BuildTriangle *it = chunkBegin; it != chunkEnd;
+                        ++it) {
+                     for (int axis = 0; axis < 3; axis++) {
+                       Bin &bin = bins[axis * BINS + binOf(*it, axis)];
+                       bin.min = glm::min(bin.min, it->min);
+                       bin.max = glm::max(bin.max, it->max);
+                       bin.count++;
+                     }
+                   }
+                 });
+
+    for (int axis = 0; axis < 3; axis++) {
+      if (scale[axis] == 0.0f) {
+        continue;
+      }
+
+      Bin bins[BINS];
+      for (unsigned i = 0; i < BINS; i++) {
+        bins[i] = emptyBin;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+          const Bin &part = chunkBins[(chunk * 3 + axis) * BINS + i];
+          bins[i].min = glm::min(bins[i].min, part.min);
+          bins[i].max = glm::max(bins[i].max, part.max);
+          bins[i].count += part.count;
+        }
+      }
+
+      float rightArea[BINS];
+      unsigned rightCount[BINS];
+      Bin right = emptyBin;
+      for (unsigned i = BINS - 1; i > 0; i--) {
+        right.min = glm::min(right.min, bins[i].min);
+        right.max = glm::max(right.max, bins[i].max);
+        right.count += bins[i].count;
+        rightArea[i] = surfaceArea(right.min, right.max);
+        rightCount[i] = right.count;
+      }
+
+      Bin left = emptyBin;
+      for (unsigned i = 1; i < BINS; i++) {
+        left.min = glm::min(left.min, bins[i - 1].min);
+        left.max = glm::max(left.max, bins[i - 1].max);
+        left.count += bins[i - 1].count;
+        if (left.count == 0 || rightCount[i] == 0) {
+          continue;
+        }
+
+        float cost = TRAVERSAL_COST +
+                     (surfaceArea(left.min, left.max) * left.count +
+                      rightArea[i] * rightCount[i]) /
+                         parentArea;
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = i;
+        }
+      }
+    }
+  }
+
+  if (bestAxis != -1) {
+    BuildTriangle *middle =
+        std::partition(begin, end, [&](const BuildTriangle &buildTriangle) {
+          return binOf(buildTriangle, bestAxis) < bestBin;
+        });
+    return middle - begin;
+  }
+
+  if (count <= MAX_LEAF_SIZE) {
+    return 0;
+  }
+
+  // no split pays for itself but the leaf would be too big, so fall back to a
+  // median split along the longest axis of the centroids
+  int axis = (centroidExtent.x > centroidExtent.y &&
+              centroidExtent.x > centroidExtent.z)
+                 ? 0
+                 : (centroidExtent.y > centroidExtent.z ? 1 : 2);
+  std::nth_element(begin, begin + count / 2, end,
+                   [axis](const BuildTriangle &a, const BuildTriangle &b) {
+                     return a.centroid[axis] < b.centroid[axis];
+                   });
+  return count / 2;
+}
+
+// bins the references along each axis by the planes where triangles may be cut
+// and returns the cost of the cheapest plane, clipping every reference to
+// each bin it spans so that the bins bound exactly their part of it
+float BoundingVolume::findSpatialSplit(const BuildTriangle *begin,
+                                       const BuildTriangle *end, int &axis,
+                                       float &position) {
+  const float maxFloat = numeric_limits<float>::max();
+  vec3 parentMin(maxFloat, maxFloat, maxFloat);
+  vec3 parentMax(-maxFloat, -maxFloat, -maxFloat);
+  for (const BuildTriangle *it = begin; it != end; ++it) {
+    parentMin = glm::min(parentMin, it->min);
+    parentMax = glm::max(parentMax, it->max);
+  }
+  const float parentArea = surfaceArea(parentMin, parentMax);
+
+  float bestCost = maxFloat;
+
+  for (int a = 0; a < 3; a++) {
+    const float width = (parentMax[a] - parentMin[a]) / SPATIAL_BINS;
+    if (!(width > 0.0f)) {
+      continue;
+    }
+
+    struct {
+      vec3 min, max;
+      // references starting and ending in the bin
+      unsigned entries, exits;
+    } bins[SPATIAL_BINS];
+    for (auto &bin : bins) {
+      bin = {vec3(maxFloat, maxFloat, maxFloat),
+             vec3(-maxFloat, -maxFloat, -maxFloat), 0, 0};
+    }
+
+    auto binOf = [&](float x) {
+      int bin = static_cast<int>((x - parentMin[a]) / width);
+      return std::min(std::max(bin, 0), static_cast<int>(SPATIAL_BINS) - 1);
+    };
+
+    for (const BuildTriangle *it = begin; it != end; ++it) {
+      const int first = binOf(it->min[a]);
+      const int last = binOf(it->max[a]);
+      bins[first].entries++;
+      bins[last].exits++;
+
+      if (first == last) {
+        bins[first].min = glm::min(bins[first].min, it->min);
+        bins[first].max = glm::max(bins[first].max, it->max);
+        continue;
+      }
+
+      for (int bin = first; bin <= last; bin++) {
+        vec3 min = it->min;
+        vec3 max = it->max;
+        min[a] = std::max(min[a], parentMin[a] + bin * width);
+        max[a] = std::min(max[a], parentMin[a] + (bin + 1) * width);
+        BuildTriangle part = clipReference(*it, min, max);
+        bins[bin].min = glm::min(bins[bin].min, part.min);
+        bins[bin].max = glm::max(bins[bin].max, part.max);
+      }
+    }
+
+    float rightArea[SPATIAL_BINS];
+    vec3 min(maxFloat, maxFloat, maxFloat);
+    vec3 max(-maxFloat, -maxFloat, -maxFloat);
+    for (unsigned i = SPATIAL_BINS - 1; i > 0; i--) {
+      min = glm::min(min, bins[i].min);
+      max = glm::max(max, bins[i].max);
+      rightArea[i] = surfaceArea(min, max);
+    }
+
+    min = vec3(maxFloat, maxFloat, maxFloat);
+    max = vec3(-maxFloat, -maxFloat, -maxFloat);
+    unsigned leftCount = 0;
+    unsigned rightCount = static_cast<unsigned>(end - begin);
+    for (unsigned i = 1; i < SPATIAL_BINS; i++) {
+      min = glm::min(min, bins[i - 1].min);
+      max = glm::max(max, bins[i - 1].max);
+      leftCount += bins[i - 1].entries;
+      rightCount -= bins[i - 1].exits;
+      if (leftCount == 0 || rightCount == 0) {
+        continue;
+      }
+
+      float cost = TRAVERSAL_COST + (surfaceArea(min, max) * leftCount +
+                                     rightArea[i] * rightCount) /
+                                        parentArea;
+      if (cost < bestCost) {
+        bestCost = cost;
+        axis = a;
+        position = parentMin[a] + i * width;
+      }
+    }
+  }
+
+  return bestCost;
+}
+
+// divides the references at a plane into the left child's followed by the
+// right's, cutting the triangles that cross it, and returns how many are on
+// the left; a crossing triangle is kept whole on one side instead when that
+// is cheaper than cutting it
+size_t BoundingVolume::spatialSplit(const BuildTriangle *begin,
+                                    const BuildTriangle *end, int axis,
+                                    float position,
+                                    vector<BuildTriangle> &references) {
+  const float maxFloat = numeric_limits<float>::max();
+  vec3 leftMin(maxFloat, maxFloat, maxFloat), rightMin = leftMin;
+  vec3 leftMax = -leftMin, rightMax = -leftMin;
+
+  vector<BuildTriangle> left;
+  vector<BuildTriangle> right;
+  vector<const BuildTriangle *> crossing;
+  for (const BuildTriangle *it = begin; it != end; ++it) {
+    if (it->max[axis] <= position) {
+      left.push_back(*it);
+      leftMin = glm::min(leftMin, it->min);
+      leftMax = glm::max(leftMax, it->max);
+    } else if (it->min[axis] >= position) {
+      right.push_back(*it);
+      rightMin = glm::min(rightMin, it->min);
+      rightMax = glm::max(rightMax, it->max);
+    } else {
+      crossing.push_back(&*it);
+    }
+  }
+
+  // keeping a triangle whole is only safe while neither side can end up empty
+  const bool mayKeepWhole = !left.empty() && !right.empty();
+
+  for (const BuildTriangle *reference : crossing) {
+    vec3 belowMax = reference->max;
+    belowMax[axis] = position;
+    vec3 aboveMin = reference->min;
+    aboveMin[axis] = position;
+    BuildTriangle below = clipReference(*reference, reference->min, belowMax);
+    BuildTriangle above = clipReference(*reference, aboveMin, reference->max);
+
+    bool keepLeft = false;
+    bool keepRight = false;
+    if (mayKeepWhole) {
+      const float leftCount = static_cast<float>(left.size());
+      const float rightCount = static_cast<float>(right.size());
+      const float leftArea = surfaceArea(leftMin, leftMax);
+      const float rightArea = surfaceArea(rightMin, rightMax);
+      const float cutCost = surfaceArea(glm::min(leftMin, below.min),
+                                        glm::max(leftMax, below.max)) *
+                                (leftCount + 1) +
+                            surfaceArea(glm::min(rightMin, above.min),
+                                        glm::max(rightMax, above.max)) *
+                                (rightCount + 1);
+      const float leftCost = surfaceArea(glm::min(leftMin, reference->min),
+                                         glm::max(leftMax, reference->max)) *
+                                 (leftCount + 1) +
+                             rightArea * rightCount;
+      const float rightCost = leftArea * leftCount +
+                              surfaceArea(glm::min(rightMin, reference->min),
+                                          glm::max(rightMax, reference->max)) *
+                                  (rightCount + 1);
+      keepLeft = leftCost < cutCost && leftCost <= rightCost;
+      keepRight = !keepLeft && rightCost < cutCost;
+    }
+
+    if (!keepRight) {
+      left.push_back(keepLeft ? *reference : below);
+      leftMin = glm::min(leftMin, left.back().min);
+      leftMax = glm::max(leftMax, left.back().max);
+    }
+    if (!keepLeft) {
+      right.push_back(keepRight ? *reference : above);
+      rightMin = glm::min(rightMin, right.back().min);
+      rightMax = glm::max(rightMax, right.back().max);
+    }
+  }
+
+  references = left;
+  references.insert(references.end(), right.begin(), right.end());
+  return left.size();
+}
+
+void BoundingVolume::setLayout(Layout layout) {
+  if (layout == Layout::Wide && wideNodes.empty() && !nodes.empty()) {
+    wideNodes.reserve(nodes.size() / 2 + 1);
+    collapse(0);
+  }
+  if (layout == Layout::Compressed && compressedNodes.empty() &&
+      !nodes.empty()) {
+    compress();
+  }
+  if (layout == Layout::Stackless && stacklessNodes.empty()) {
+    stacklessNodes = stackless();
+  }
+
+  this->layout = layout;
+}
+
+size_t BoundingVolume::nodeBytes() const {
+  switch (layout) {
+  case Layout::Wide:
+    return wideNodes.size() * sizeof(WideNode);
+  case Layout::Compressed:
+    return compressedNodes.size() * sizeof(CompressedNode);
+  case Layout::Stackless:
+    return stacklessNodes.size() * sizeof(Node);
+  default:
+    return nodes.size() * sizeof(Node);
+  }
+}
+
+const BoundingVolume::Nodes &BoundingVolume::getNodes() const { return nodes; }
+
+const Ptr_Triangles &BoundingVolume::getTriangles() const { return triangles; }
+
+// leaves are fitted to their triangles in parallel, then every parent to its
+// children; children always follow their parent in the array, so walking it
+// backwards reaches them first
+bool BoundingVolume::refit(float maxCostGrowth) {
+  const int nodeCount = static_cast<int>(nodes.size());
+
+#pragma omp parallel for
+  for (int index = 0; index < nodeCount; index++) {
+    Node &node = nodes[index];
+    if (!node.isLeaf()) {
+      continue;
+    }
+
+    for (int i = 0; i < 7; i++) {
+      node.d[0][i] = numeric_limits<float>::max();
+      node.d[1][i] = -numeric_limits<float>::max();
+    }
+    for (unsigned t = node.offset; t < node.offset + node.count; t++) {
+      for (const vec3 &vertex :
+           {triangles[t]->v0, triangles[t]->v1, triangles[t]->v2}) {
+        for (int i = 0; i < 7; i++) {
+          float D = glm::dot(normals[i], vertex);
+          node.d[0][i] = std::min(node.d[0][i], D);
+          node.d[1][i] = std::max(node.d[1][i], D);
+        }
+      }
+    }
+  }
+
+  for (int index = nodeCount - 1; index >= 0; index--) {
+    Node &node = nodes[index];
+    if (!node.isLeaf()) {
+      fitParent(node, nodes[node.offset], nodes[node.offset + 1]);
+    }
+  }
+
+  bool rebuilt = false;
+  if (maxCostGrowth > 0.0f && sahCost() > maxCostGrowth * builtCost) {
+    // a triangle cut by spatial splits is referenced by several leaves
+    Ptr_Triangles unique(triangles);
+    if (buildMode == BuildMode::Spatial) {
+      std::sort(unique.begin(), unique.end());
+      unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    }
+
+    nodes.clear();
+    triangles.clear();
+    build(unique);
+    builtCost = sahCost();
+    rebuilt = true;
+  }
+  packed = PackedTriangles(triangles);
+
+  // the wide nodes are cheap to collapse again from the binary ones
+  if (!wideNodes.empty()) {
+    wideNodes.clear();
+    collapse(0);
+  }
+  if (!compressedNodes.empty()) {
+    compress();
+  }
+  if (!stacklessNodes.empty()) {
+    stacklessNodes = stackless();
+  }
+
+  return rebuilt;
+}
+
+// every node is weighted by the chance that a ray through the root also
+// passes through it
+float BoundingVolume::sahCost() const {
+  if (nodes.empty()) {
+    return 0.0f;
+  }
+
+  float cost = 0.0f;
+  for (const Node &node : nodes) {
+    cost += surfaceArea(node) *
+            (node.isLeaf() ? static_cast<float>(node.count) : TRAVERSAL_COST);
+  }
+  return cost / surfaceArea(nodes[0]);
+}
+
+// depths are found walking down from the root; boxes are taken from the
+// first three slabs, which are the axes
+BoundingVolume::Statistics BoundingVolume::statistics() const {
+  Statistics stats = {sahCost(), static_cast<unsigned>(nodes.size()), 0, 0,
+                      0.0f, vector<unsigned>(), 0.0f};
+  if (nodes.empty()) {
+    return stats;
+  }
+
+  auto boxVolume = [](vec3 min, vec3 max) {
+    vec3 extent = glm::max(max - min, vec3(0.0f, 0.0f, 0.0f));
+    return extent.x * extent.y * extent.z;
+  };
+  auto boxMin = [](const Node &node) {
+    return vec3(node.d[0][0], node.d[0][1], node.d[0][2]);
+  };
+  auto boxMax = [](const Node &node) {
+    return vec3(node.d[1][0], node.d[1][1], node.d[1][2]);
+  };
+
+  float overlap = 0.0f;
+  unsigned depthSum = 0;
+  vector<std::pair<unsigned, unsigned>> stack = {{0, 0}};
+  while (!stack.empty()) {
+    const unsigned index = stack.back().first;
+    const unsigned depth = stack.back().second;
+    stack.pop_back();
+
+    const Node &node = nodes[index];
+    if (node.isLeaf()) {
+      ++stats.leafCount;
+      stats.maxDepth = std::max(stats.maxDepth, depth);
+      depthSum += depth;
+      if (stats.leafSizes.size() <= node.count) {
+        stats.leafSizes.resize(node.count + 1, 0);
+      }
+      ++stats.leafSizes[node.count];
+      continue;
+    }
+
+    const Node &first = nodes[node.offset];
+    const Node &second = nodes[node.offset + 1];
+    overlap += boxVolume(glm::max(boxMin(first), boxMin(second)),
+                         glm::min(boxMax(first), boxMax(second)));
+
+    stack.emplace_back(node.offset, depth + 1);
+    stack.emplace_back(node.offset + 1, depth + 1);
+  }
+
+  const float rootVolume = boxVolume(boxMin(nodes[0]), boxMax(nodes[0]));
+  stats.averageLeafDepth = static_cast<float>(depthSum) / stats.leafCount;
+  stats.overlap = (rootVolume > 0.0f) ? overlap / rootVolume : 0.0f;
+  return stats;
+}
+
+// appends a wide node for the binary node at index, pulling up grandchildren
+// until it has four children, and returns its index; the child with the
+// largest area is opened first since it is the most likely to be visited
+unsigned BoundingVolume::collapse(unsigned index) {
+  unsigned lanes[4] = {index};
+  unsigned laneCount = 1;
+
+  if (!nodes[index].isLeaf()) {
+    lanes[0] = nodes[index].offset;
+    lanes[1] = nodes[index].offset + 1;
+    laneCount = 2;
+  }
+
+  while (laneCount < 4) {
+    int largest = -1;
+    float largestArea = -1.0f;
+    for (unsigned j = 0; j < laneCount; j++) {
+      if (!nodes[lanes[j]].isLeaf() &&
+          surfaceArea(nodes[lanes[j]]) > largestArea) {
+        largest = j;
+        largestArea = surfaceArea(nodes[lanes[j]]);
+      }
+    }
+    if (largest == -1) {
+      break;
+    }
+
+    unsigned opened = lanes[largest];
+    lanes[largest] = nodes[opened].offset;
+    lanes[laneCount++] = nodes[opened].offset + 1;
+  }
+
+  const unsigned wideIndex = static_cast<unsigned>(wideNodes.size());
+  wideNodes.emplace_back();
+
+  for (unsigned j = 0; j < 4; j++) {
+    WideNode &wide = wideNodes[wideIndex];
+    for (int i = 0; i < 7; i++) {
+      wide.d[i][0][j] = (j < laneCount) ? nodes[lanes[j]].d[0][i]
+                                        : numeric_limits<float>::max();
+      wide.d[i][1][j] = (j < laneCount) ? nodes[lanes[j]].d[1][i]
+                                        : -numeric_limits<float>::max();
+    }
+    wide.offset[j] = (j < laneCount) ? nodes[lanes[j]].offset : 0;
+    wide.count[j] = (j < laneCount) ? nodes[lanes[j]].count : 0;
+  }
+
+  // the array grows while collapsing the children, so the node is looked up by
+  // index after each one
+  for (unsigned j = 0; j < laneCount; j++) {
+    if (!nodes[lanes[j]].isLeaf()) {
+      unsigned child = collapse(lanes[j]);
+      wideNodes[wideIndex].offset[j] = child;
+    }
+  }
+
+  return wideIndex;
+}
+
+BoundingVolume::Nodes BoundingVolume::stackless() const {
+  Nodes ordered;
+  ordered.reserve(nodes.size());
+  if (!nodes.empty()) {
+    appendStackless(0, ordered);
+  }
+  return ordered;
+}
+
+void BoundingVolume::appendStackless(unsigned index, Nodes &ordered) const {
+  const size_t position = ordered.size();
+  ordered.push_back(nodes[index]);
+  if (!nodes[index].isLeaf()) {
+    appendStackless(nodes[index].offset, ordered);
+    appendStackless(nodes[index].offset + 1, ordered);
+    ordered[position].offset = static_cast<unsigned>(ordered.size());
+  }
+}
+
+// the sibling pairs are listed in their new order and every interior node's
+// offset is then mapped to where its children have moved; a treelet grows
+// from its first pair by adding whichever pair reachable from it has the
+// largest area, as the most likely to be visited, until it fills a block,
+// and the pairs left reachable start the treelets after it
+void BoundingVolume::reorder(NodeOrder order) {
+  if (nodes.size() < 3) {
+    return;
+  }
+
+  vector<unsigned> pairs;
+  pairs.reserve(nodes.size() / 2);
+  auto pushChildren = [&](std::deque<unsigned> &queue, unsigned pair) {
+    for (unsigned index : {pair, pair + 1}) {
+      if (!nodes[index].isLeaf()) {
+        queue.push_back(nodes[index].offset);
+      }
+    }
+  };
+
+  std::deque<unsigned> queue = {nodes[0].offset};
+  if (order == NodeOrder::BreadthFirst) {
+    while (!queue.empty()) {
+      pairs.push_back(queue.front());
+      queue.pop_front();
+      pushChildren(queue, pairs.back());
+    }
+  } else if (order == NodeOrder::DepthFirst) {
+    while (!queue.empty()) {
+      pairs.push_back(queue.back());
+      queue.pop_back();
+      // the first child's pair is pushed last, so it is taken next
+      std::deque<unsigned> children;
+      pushChildren(children, pairs.back());
+      queue.insert(queue.end(), children.rbegin(), children.rend());
+    }
+  } else {
+    const unsigned treeletPairs = TREELET_BYTES / (2 * sizeof(Node));
+    auto area = [&](unsigned pair) {
+      return surfaceArea(nodes[pair]) + surfaceArea(nodes[pair + 1]);
+    };
+    auto smaller = [&](unsigned a, unsigned b) { return area(a) < area(b); };
+
+    while (!queue.empty()) {
+      vector<unsigned> frontier = {queue.front()};
+      queue.pop_front();
+      for (unsigned placed = 0; placed < treeletPairs && !frontier.empty();
+           placed++) {
+        std::pop_heap(frontier.begin(), frontier.end(), smaller);
+        pairs.push_back(frontier.back());
+        frontier.pop_back();
+
+        std::deque<unsigned> children;
+        pushChildren(children, pairs.back());
+        for (unsigned child : children) {
+          frontier.push_back(child);
+          std::push_heap(frontier.begin(), frontier.end(), smaller);
+        }
+      }
+      std::sort_heap(frontier.begin(), frontier.end(), smaller);
+      queue.insert(queue.end(), frontier.rbegin(), frontier.rend());
+    }
+  }
+
+  vector<unsigned> moved(nodes.size());
+  moved[0] = 0;
+  for (unsigned i = 0; i < pairs.size(); i++) {
+    moved[pairs[i]] = 2 * i + 1;
+    moved[pairs[i] + 1] = 2 * i + 2;
+  }
+
+  Nodes ordered(nodes.size());
+  for (unsigned index = 0; index < nodes.size(); index++) {
+    Node node = nodes[index];
+    if (!node.isLeaf()) {
+      node.offset = moved[node.offset];
+    }
+    ordered[moved[index]] = node;
+  }
+  nodes.swap(ordered);
+
+  if (!wideNodes.empty()) {
+    wideNodes.clear();
+    collapse(0);
+  }
+  if (!compressedNodes.empty()) {
+    compress();
+  }
+  if (!stacklessNodes.empty()) {
+    stacklessNodes = stackless();
+  }
+}
+
+float BoundingVolume::layoutCost(unsigned blockBytes) const {
+  if (nodes.empty()) {
+    return 0.0f;
+  }
+
+  const unsigned nodesPerBlock =
+      std::max(blockBytes / static_cast<unsigned>(sizeof(Node)), 1u);
+  float cost = surfaceArea(nodes[0]);
+  for (unsigned index = 0; index < nodes.size(); index++) {
+    const Node &node = nodes[index];
+    if (node.isLeaf()) {
+      continue;
+    }
+    for (unsigned child : {node.offset, node.offset + 1}) {
+      if (child / nodesPerBlock != index / nodesPerBlock) {
+        cost += surfaceArea(nodes[child]);
+      }
+    }
+  }
+  return cost / surfaceArea(nodes[0]);
+}
+
+// the compressed nodes share the wide nodes' indices, so they are quantised
+// one for one; wide nodes collapsed only to be compressed are freed again
+void BoundingVolume::compress() {
+  const bool keepWide = !wideNodes.empty();
+  if (!keepWide) {
+    wideNodes.reserve(nodes.size() / 2 + 1);
+    collapse(0);
+  }
+
+  compressedNodes.resize(wideNodes.size());
+  for (size_t i = 0; i < wideNodes.size(); i++) {
+    quantise(wideNodes[i], compressedNodes[i]);
+  }
+
+  if (!keepWide) {
+    wideNodes.clear();
+    wideNodes.shrink_to_fit();
+  }
+}
+
+// each slab's steps are the smallest power of two that reaches across all
+// the children in 255 steps; rounding in the addition is corrected for by
+// stepping the quantised bounds outwards until they contain the exact ones
+void BoundingVolume::quantise(const WideNode &wide, CompressedNode &node) {
+  node.laneCount = 0;
+  while (node.laneCount < 4 &&
+         wide.d[0][0][node.laneCount] <= wide.d[0][1][node.laneCount]) {
+    ++node.laneCount;
+  }
+
   for (int i = 0; i < 7; i++) {
-    d[i][0] = numeric_limits<float>::max();
-    d[i][1] = numeric_limits<float>::min();
-    for (Ptr_Triangle triangle : triangles) {
-      for (const vec3 vertex : triangle->getVertices()) {
-        float D = normals[i].x * vertex.x + normals[i].y * vertex.y +
-                  normals[i].z * vertex.z;
-        d[i][0] = std::min(d[i][0], D);
-        d[i][1] = std::max(d[i][1], D);
+    float lo = numeric_limits<float>::max();
+    float hi = -numeric_limits<float>::max();
+    for (unsigned j = 0; j < node.laneCount; j++) {
+      lo = std::min(lo, wide.d[i][0][j]);
+      hi = std::max(hi, wide.d[i][1][j]);
+    }
+
+    int exponent;
+    std::frexp((hi - lo) / 255.0f, &exponent);
+    exponent = std::max(exponent, -126);
+    while (exponent < 127 && lo + 255.0f * std::ldexp(1.0f, exponent) < hi) {
+      ++exponent;
+    }
+    const float step = std::ldexp(1.0f, exponent);
+
+    node.origin[i] = lo;
+    node.exponent[i] = static_cast<int8_t>(exponent);
+
+    for (unsigned j = 0; j < 4; j++) {
+      if (j >= node.laneCount) {
+        node.q[i][0][j] = 255;
+        node.q[i][1][j] = 0;
+        continue;
       }
+
+      int qNear = static_cast<int>((wide.d[i][0][j] - lo) / step);
+      qNear = std::min(std::max(qNear, 0), 255);
+      while (qNear > 0 && lo + qNear * step > wide.d[i][0][j]) {
+        --qNear;
+      }
+
+      int qFar = static_cast<int>(std::ceil((wide.d[i][1][j] - lo) / step));
+      qFar = std::min(std::max(qFar, 0), 255);
+      while (qFar < 255 && lo + qFar * step < wide.d[i][1][j]) {
+        ++qFar;
+      }
+
+      node.q[i][0][j] = static_cast<uint8_t>(qNear);
+      node.q[i][1][j] = static_cast<uint8_t>(qFar);
     }
   }
+
+  for (unsigned j = 0; j < 4; j++) {
+    node.offset[j] = wide.offset[j];
+    node.count[j] = wide.count[j];
+  }
+}
+
+bool BoundingVolume::closestIntersection(Ray &ray) const {
+  switch (layout) {
+  case Layout::Wide:
+    return wideClosestIntersection(ray);
+  case Layout::Compressed:
+    return compressedClosestIntersection(ray);
+  case Layout::Stackless:
+    return stacklessClosestIntersection(ray);
+  default:
+    return binaryClosestIntersection(ray);
+  }
+}
+
+static float horizontalMax(__m128 v) {
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_cvtss_f32(v);
 }
 
-bool BoundingVolume::calculateIntersection(Ray &ray, bool topVolume) const {
-  float num[7];
-  float denom[7];
+static float horizontalMin(__m128 v) {
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_cvtss_f32(v);
+}
+
+BoundingVolume::RaySlabs::RaySlabs(const Ray &ray) {
+  alignas(16) float rowNum[8] = {0};
+  alignas(16) float rowInv[8] = {0};
   for (int i = 0; i < 7; i++) {
-    num[i] = glm::dot(normals[i], ray.getPosition());
-    denom[i] = glm::dot(normals[i], ray.getDirection());
+    rowNum[i] = glm::dot(normals[i], ray.getPosition());
+    rowInv[i] = reciprocal(glm::dot(normals[i], ray.getDirection()));
   }
-  bool intersection = calculateIntersectionSub(ray, num, denom);
-  if (intersection && topVolume && ray.getCollision()->isMirrored()) {
-    ray.reflect();
+  num[0] = _mm_load_ps(rowNum);
+  num[1] = _mm_load_ps(rowNum + 4);
+  inv[0] = _mm_load_ps(rowInv);
+  inv[1] = _mm_load_ps(rowInv + 4);
+}
 
-    return calculateIntersection(ray, true);
-  } else {
-    return intersection;
+BoundingVolume::PacketSlabs::PacketSlabs(const RaySlabs *slabs,
+                                         unsigned count) {
+  const __m128 lastLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  for (int group = 0; group < 2; group++) {
+    numLo[group] = numHi[group] = slabs[0].num[group];
+    invLo[group] = invHi[group] = slabs[0].inv[group];
+    for (unsigned i = 1; i < count; i++) {
+      numLo[group] = _mm_min_ps(numLo[group], slabs[i].num[group]);
+      numHi[group] = _mm_max_ps(numHi[group], slabs[i].num[group]);
+      invLo[group] = _mm_min_ps(invLo[group], slabs[i].inv[group]);
+      invHi[group] = _mm_max_ps(invHi[group], slabs[i].inv[group]);
+    }
+    ignored[group] =
+        _mm_and_ps(_mm_cmplt_ps(invLo[group], _mm_setzero_ps()),
+                   _mm_cmpgt_ps(invHi[group], _mm_setzero_ps()));
+  }
+  ignored[1] = _mm_or_ps(ignored[1], lastLane);
+}
+
+// the seven slabs are tested in two groups of four lanes; the last lane of
+// the second group reads past the row into the next one, so it is masked out
+// of the far distance, while its near distance is always zero
+bool BoundingVolume::intersectsNode(const Node &node, const RaySlabs &slabs,
+                                    float tMax, float &tNear) {
+  const __m128 lastLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 far = _mm_set1_ps(tMax);
+
+  __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.d[0]), slabs.num[0]),
+                         slabs.inv[0]);
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.d[1]), slabs.num[0]),
+                         slabs.inv[0]);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.d[0] + 4), slabs.num[1]),
+                         slabs.inv[1]);
+  __m128 t3 = _mm_mul_ps(
+      _mm_sub_ps(_mm_loadu_ps(node.d[1] + 4), slabs.num[1]), slabs.inv[1]);
+
+  __m128 nearLanes = _mm_max_ps(_mm_min_ps(t0, t1), _mm_min_ps(t2, t3));
+  __m128 farLanes = _mm_min_ps(
+      _mm_max_ps(t0, t1),
+      _mm_or_ps(_mm_andnot_ps(lastLane, _mm_max_ps(t2, t3)),
+                _mm_and_ps(lastLane, far)));
+
+  tNear = horizontalMax(_mm_max_ps(nearLanes, _mm_setzero_ps()));
+  return tNear <= horizontalMin(_mm_min_ps(farLanes, far));
+}
+
+// the distance to each bound of a slab is bounded over the whole packet by
+// the products of the ends of the ranges, which is only sound where the
+// reciprocal directions share a sign; as in intersectsNode, the last lane of
+// the far bounds reads past the row and is ignored
+bool BoundingVolume::packetMissesNode(const Node &node,
+                                      const PacketSlabs &packet, float tMax) {
+  const __m128 huge = _mm_set1_ps(numeric_limits<float>::max());
+  __m128 entry = _mm_setzero_ps();
+  __m128 exit = _mm_set1_ps(tMax);
+
+  for (int group = 0; group < 2; group++) {
+    const __m128 bounds[2] = {_mm_load_ps(node.d[0] + 4 * group),
+                              _mm_loadu_ps(node.d[1] + 4 * group)};
+    __m128 tLo = huge;
+    __m128 tHi = _mm_sub_ps(_mm_setzero_ps(), huge);
+    for (const __m128 &bound : bounds) {
+      const __m128 lo = _mm_sub_ps(bound, packet.numHi[group]);
+      const __m128 hi = _mm_sub_ps(bound, packet.numLo[group]);
+      for (const __m128 &inv : {packet.invLo[group], packet.invHi[group]}) {
+        const __m128 t0 = _mm_mul_ps(lo, inv);
+        const __m128 t1 = _mm_mul_ps(hi, inv);
+        tLo = _mm_min_ps(tLo, _mm_min_ps(t0, t1));
+        tHi = _mm_max_ps(tHi, _mm_max_ps(t0, t1));
+      }
+    }
+
+    const __m128 ignored = packet.ignored[group];
+    entry = _mm_max_ps(entry, _mm_andnot_ps(ignored, tLo));
+    exit = _mm_min_ps(exit, _mm_or_ps(_mm_and_ps(ignored, huge),
+                                      _mm_andnot_ps(ignored, tHi)));
+  }
+
+  return horizontalMax(entry) > horizontalMin(exit);
+}
+
+// walks the node array front to back, always entering the nearer child first
+// and skipping any node the ray enters beyond the closest hit found so far
+bool BoundingVolume::binaryClosestIntersection(Ray &ray) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const RaySlabs slabs(ray);
+
+  float tNear;
+  if (!intersectsNode(nodes[0], slabs, ray.getLength(), tNear)) {
+    return false;
+  }
+
+  bool anyIntersection = false;
+
+  struct {
+    unsigned index;
+    float tNear;
+  } stack[STACK_SIZE];
+  unsigned stackSize = 0;
+  unsigned index = 0;
+
+  while (true) {
+    const Node &node = nodes[index];
+    TraceStats::countNode();
+    if (node.isLeaf()) {
+      TraceStats::countTriangle(node.count);
+      anyIntersection |=
+          packed.calculateIntersection(node.offset, node.count, ray);
+    } else {
+      float tFirst, tSecond;
+      bool first =
+          intersectsNode(nodes[node.offset], slabs, ray.getLength(), tFirst);
+      bool second = intersectsNode(nodes[node.offset + 1], slabs,
+                                   ray.getLength(), tSecond);
+
+      if (first && second) {
+        if (tSecond < tFirst) {
+          stack[stackSize++] = {node.offset, tFirst};
+          index = node.offset + 1;
+        } else {
+          stack[stackSize++] = {node.offset + 1, tSecond};
+          index = node.offset;
+        }
+        continue;
+      } else if (first || second) {
+        index = first ? node.offset : node.offset + 1;
+        continue;
+      }
+    }
+
+    // the ray may have been shortened since a node was pushed
+    do {
+      if (stackSize == 0) {
+        return anyIntersection;
+      }
+      --stackSize;
+    } while (stack[stackSize].tNear > ray.getLength());
+    index = stack[stackSize].index;
   }
 }
 
-// ray must have max length before initial call
-bool BoundingVolume::calculateIntersectionSub(Ray &ray, float num[7],
-                                              float denom[7]) const {
-  float tFar = numeric_limits<float>::max();
-  float tNear = -numeric_limits<float>::max();
+// same front to back walk as binaryClosestIntersection over the wide nodes;
+// the slabs of all four children are tested at once, using the precomputed
+// reciprocal of the ray direction along each normal rather than dividing,
+// and picking the near and far bound of each slab from the direction's sign
+// so that unused lanes with inverted bounds always miss
+bool BoundingVolume::wideClosestIntersection(Ray &ray) const {
+  if (wideNodes.empty()) {
+    return false;
+  }
+
+  __m128 num[7];
+  __m128 inv[7];
+  int near[7];
   for (int i = 0; i < 7; i++) {
-    float tn = (d[i][0] - num[i]) / denom[i];
-    float tf = (d[i][1] - num[i]) / denom[i];
-    if (denom[i] < 0)
-      std::swap(tn, tf);
-    tNear = (tn > tNear) ? tn : tNear;
-    tFar = (tf < tFar) ? tf : tFar;
-    if (tNear > tFar) {
+    float reciprocalDenom =
+        reciprocal(glm::dot(normals[i], ray.getDirection()));
+    num[i] = _mm_set1_ps(glm::dot(normals[i], ray.getPosition()));
+    inv[i] = _mm_set1_ps(reciprocalDenom);
+    near[i] = (reciprocalDenom < 0.0f) ? 1 : 0;
+  }
+
+  bool anyIntersection = false;
+
+  struct StackEntry {
+    unsigned offset;
+    unsigned count;
+    float tNear;
+  } stack[WIDE_STACK_SIZE];
+  stack[0] = {0, 0, 0.0f};
+  unsigned stackSize = 1;
+
+  while (stackSize > 0) {
+    const StackEntry entry = stack[--stackSize];
+    if (entry.tNear > ray.getLength()) {
+      continue;
+    }
+    TraceStats::countNode();
+
+    if (entry.count != 0) {
+      TraceStats::countTriangle(entry.count);
+      anyIntersection |=
+          packed.calculateIntersection(entry.offset, entry.count, ray);
+      continue;
+    }
+
+    const WideNode &node = wideNodes[entry.offset];
+    __m128 tNear = _mm_setzero_ps();
+    __m128 tFar = _mm_set1_ps(ray.getLength());
+    for (int i = 0; i < 7; i++) {
+      __m128 tn = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(node.d[i][near[i]]), num[i]), inv[i]);
+      __m128 tf = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(node.d[i][1 - near[i]]), num[i]), inv[i]);
+      tNear = _mm_max_ps(tNear, tn);
+      tFar = _mm_min_ps(tFar, tf);
+    }
+
+    int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    float childNear[4];
+    _mm_storeu_ps(childNear, tNear);
+
+    // push farther children first so the nearest one is popped next
+    const unsigned pushed = stackSize;
+    for (unsigned j = 0; j < 4; j++) {
+      if (mask & (1 << j)) {
+        unsigned k = stackSize++;
+        for (; k > pushed && stack[k - 1].tNear < childNear[j]; k--) {
+          stack[k] = stack[k - 1];
+        }
+        stack[k] = {node.offset[j], node.count[j], childNear[j]};
+      }
+    }
+  }
+
+  return anyIntersection;
+}
+
+// depth first walk that stops at the first triangle blocking the ray, so the
+// order children are visited in does not matter
+bool BoundingVolume::binaryAnyIntersection(const Ray &ray) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const RaySlabs slabs(ray);
+
+  float tNear;
+  if (!intersectsNode(nodes[0], slabs, ray.getLength(), tNear)) {
+    return false;
+  }
+
+  unsigned stack[STACK_SIZE];
+  unsigned stackSize = 0;
+  unsigned index = 0;
+
+  while (true) {
+    const Node &node = nodes[index];
+    TraceStats::countNode();
+    if (node.isLeaf()) {
+      TraceStats::countTriangle(node.count);
+      if (packed.calculateAnyIntersection(node.offset, node.count, ray)) {
+        return true;
+      }
+    } else {
+      bool first =
+          intersectsNode(nodes[node.offset], slabs, ray.getLength(), tNear);
+      bool second =
+          intersectsNode(nodes[node.offset + 1], slabs, ray.getLength(), tNear);
+
+      if (first && second) {
+        stack[stackSize++] = node.offset + 1;
+        index = node.offset;
+        continue;
+      } else if (first || second) {
+        index = first ? node.offset : node.offset + 1;
+        continue;
+      }
+    }
+
+    if (stackSize == 0) {
       return false;
     }
+    index = stack[--stackSize];
+  }
+}
+
+// the wide counterpart of binaryAnyIntersection, pushing every child hit
+bool BoundingVolume::wideAnyIntersection(const Ray &ray) const {
+  if (wideNodes.empty()) {
+    return false;
+  }
+
+  __m128 num[7];
+  __m128 inv[7];
+  int near[7];
+  for (int i = 0; i < 7; i++) {
+    float reciprocalDenom =
+        reciprocal(glm::dot(normals[i], ray.getDirection()));
+    num[i] = _mm_set1_ps(glm::dot(normals[i], ray.getPosition()));
+    inv[i] = _mm_set1_ps(reciprocalDenom);
+    near[i] = (reciprocalDenom < 0.0f) ? 1 : 0;
+  }
+
+  struct StackEntry {
+    unsigned offset;
+    unsigned count;
+  } stack[WIDE_STACK_SIZE];
+  stack[0] = {0, 0};
+  unsigned stackSize = 1;
+
+  const __m128 length = _mm_set1_ps(ray.getLength());
+
+  while (stackSize > 0) {
+    const StackEntry entry = stack[--stackSize];
+    TraceStats::countNode();
+
+    if (entry.count != 0) {
+      TraceStats::countTriangle(entry.count);
+      if (packed.calculateAnyIntersection(entry.offset, entry.count, ray)) {
+        return true;
+      }
+      continue;
+    }
+
+    const WideNode &node = wideNodes[entry.offset];
+    __m128 tNear = _mm_setzero_ps();
+    __m128 tFar = length;
+    for (int i = 0; i < 7; i++) {
+      __m128 tn = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(node.d[i][near[i]]), num[i]), inv[i]);
+      __m128 tf = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(node.d[i][1 - near[i]]), num[i]), inv[i]);
+      tNear = _mm_max_ps(tNear, tn);
+      tFar = _mm_min_ps(tFar, tf);
+    }
+
+    int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    for (unsigned j = 0; j < 4; j++) {
+      if (mask & (1 << j)) {
+        stack[stackSize++] = {node.offset[j], node.count[j]};
+      }
+    }
   }
 
-  // first check the geometry with this volume as direct parent
-  bool anyIntersection = ClosestIntersection(ray);
+  return false;
+}
+
+// the four eight bit steps of one bound of a slab, as floats
+static __m128 widen(const uint8_t *q) {
+  int packed;
+  std::memcpy(&packed, q, sizeof(packed));
+  const __m128i zero = _mm_setzero_si128();
+  __m128i bytes = _mm_cvtsi32_si128(packed);
+  return _mm_cvtepi32_ps(
+      _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+// tests the ray against the children of a compressed node, returning a bit
+// for each child hit and where the ray enters them; the length of a step is
+// built straight from its exponent's bits
+static int intersectsChildren(const BoundingVolume::CompressedNode &node,
+                              const __m128 num[7], const __m128 inv[7],
+                              const int near[7], float tMax, __m128 &tNear) {
+  tNear = _mm_setzero_ps();
+  __m128 tFar = _mm_set1_ps(tMax);
+  for (int i = 0; i < 7; i++) {
+    const __m128 origin = _mm_set1_ps(node.origin[i]);
+    const __m128 step =
+        _mm_castsi128_ps(_mm_set1_epi32((node.exponent[i] + 127) << 23));
+    __m128 dNear =
+        _mm_add_ps(origin, _mm_mul_ps(widen(node.q[i][near[i]]), step));
+    __m128 dFar =
+        _mm_add_ps(origin, _mm_mul_ps(widen(node.q[i][1 - near[i]]), step));
+    tNear = _mm_max_ps(tNear, _mm_mul_ps(_mm_sub_ps(dNear, num[i]), inv[i]));
+    tFar = _mm_min_ps(tFar, _mm_mul_ps(_mm_sub_ps(dFar, num[i]), inv[i]));
+  }
+
+  return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) &
+         ((1 << node.laneCount) - 1);
+}
+
+// the same walk as wideClosestIntersection over the compressed nodes
+bool BoundingVolume::compressedClosestIntersection(Ray &ray) const {
+  if (compressedNodes.empty()) {
+    return false;
+  }
+
+  __m128 num[7];
+  __m128 inv[7];
+  int near[7];
+  for (int i = 0; i < 7; i++) {
+    float reciprocalDenom =
+        reciprocal(glm::dot(normals[i], ray.getDirection()));
+    num[i] = _mm_set1_ps(glm::dot(normals[i], ray.getPosition()));
+    inv[i] = _mm_set1_ps(reciprocalDenom);
+    near[i] = (reciprocalDenom < 0.0f) ? 1 : 0;
+  }
+
+  bool anyIntersection = false;
+
+  struct StackEntry {
+    unsigned offset;
+    unsigned count;
+    float tNear;
+  } stack[WIDE_STACK_SIZE];
+  stack[0] = {0, 0, 0.0f};
+  unsigned stackSize = 1;
 
-  // then check sub volumes if there are any
-  for (unsigned i = 0; i < subVolumes.size(); i++) {
-    anyIntersection |= subVolumes[i].calculateIntersectionSub(ray, num, denom);
+  while (stackSize > 0) {
+    const StackEntry entry = stack[--stackSize];
+    if (entry.tNear > ray.getLength()) {
+      continue;
+    }
+    TraceStats::countNode();
+
+    if (entry.count != 0) {
+      TraceStats::countTriangle(entry.count);
+      anyIntersection |=
+          packed.calculateIntersection(entry.offset, entry.count, ray);
+      continue;
+    }
+
+    const CompressedNode &node = compressedNodes[entry.offset];
+    __m128 tNear;
+    int mask = intersectsChildren(node, num, inv, near, ray.getLength(), tNear);
+    float childNear[4];
+    _mm_storeu_ps(childNear, tNear);
+
+    const unsigned pushed = stackSize;
+    for (unsigned j = 0; j < 4; j++) {
+      if (mask & (1 << j)) {
+        unsigned k = stackSize++;
+        for (; k > pushed && stack[k - 1].tNear < childNear[j]; k--) {
+          stack[k] = stack[k - 1];
+        }
+        stack[k] = {node.offset[j], node.count[j], childNear[j]};
+      }
+    }
   }
 
   return anyIntersection;
 }
 
-bool BoundingVolume::ClosestIntersection(Ray &ray) const {
+bool BoundingVolume::compressedAnyIntersection(const Ray &ray) const {
+  if (compressedNodes.empty()) {
+    return false;
+  }
+
+  __m128 num[7];
+  __m128 inv[7];
+  int near[7];
+  for (int i = 0; i < 7; i++) {
+    float reciprocalDenom =
+        reciprocal(glm::dot(normals[i], ray.getDirection()));
+    num[i] = _mm_set1_ps(glm::dot(normals[i], ray.getPosition()));
+    inv[i] = _mm_set1_ps(reciprocalDenom);
+    near[i] = (reciprocalDenom < 0.0f) ? 1 : 0;
+  }
+
+  struct StackEntry {
+    unsigned offset;
+    unsigned count;
+  } stack[WIDE_STACK_SIZE];
+  stack[0] = {0, 0};
+  unsigned stackSize = 1;
+
+  while (stackSize > 0) {
+    const StackEntry entry = stack[--stackSize];
+    TraceStats::countNode();
+
+    if (entry.count != 0) {
+      TraceStats::countTriangle(entry.count);
+      if (packed.calculateAnyIntersection(entry.offset, entry.count, ray)) {
+        return true;
+      }
+      continue;
+    }
+
+    const CompressedNode &node = compressedNodes[entry.offset];
+    __m128 tNear;
+    int mask = intersectsChildren(node, num, inv, near, ray.getLength(), tNear);
+    for (unsigned j = 0; j < 4; j++) {
+      if (mask & (1 << j)) {
+        stack[stackSize++] = {node.offset[j], node.count[j]};
+      }
+    }
+  }
+
+  return false;
+}
+
+// a node the ray hits is followed by its first child, or by the next subtree
+// for a leaf, and a node it misses is skipped by jumping past its subtree;
+// children are always taken in the same order rather than nearest first, so
+// the closest hit culls less than in the other layouts
+bool BoundingVolume::stacklessClosestIntersection(Ray &ray) const {
+  const RaySlabs slabs(ray);
+  const unsigned nodeCount = static_cast<unsigned>(stacklessNodes.size());
 
   bool anyIntersection = false;
+  unsigned index = 0;
+  while (index < nodeCount) {
+    const Node &node = stacklessNodes[index];
+    TraceStats::countNode();
 
-  for (Ptr_Triangle triangle : triangles) {
-    anyIntersection |= triangle->calculateIntersection(ray);
+    float tNear;
+    const bool hit = intersectsNode(node, slabs, ray.getLength(), tNear);
+    if (hit && node.isLeaf()) {
+      TraceStats::countTriangle(node.count);
+      anyIntersection |=
+          packed.calculateIntersection(node.offset, node.count, ray);
+    }
+    index = (hit || node.isLeaf()) ? index + 1 : node.offset;
   }
 
   return anyIntersection;
 }
 
-void BoundingVolume::setSubVolume(BoundingVolume volume) {
-  subVolumes.push_back(volume);
+bool BoundingVolume::stacklessAnyIntersection(const Ray &ray) const {
+  const RaySlabs slabs(ray);
+  const unsigned nodeCount = static_cast<unsigned>(stacklessNodes.size());
+
+  unsigned index = 0;
+  while (index < nodeCount) {
+    const Node &node = stacklessNodes[index];
+    TraceStats::countNode();
+
+    float tNear;
+    const bool hit = intersectsNode(node, slabs, ray.getLength(), tNear);
+    if (hit && node.isLeaf()) {
+      TraceStats::countTriangle(node.count);
+      if (packed.calculateAnyIntersection(node.offset, node.count, ray)) {
+        return true;
+      }
+    }
+    index = (hit || node.isLeaf()) ? index + 1 : node.offset;
+  }
+
+  return false;
 }
 
-// recursively checks for ANY intersection, backs out early
-bool BoundingVolume::calculateAnyIntersection(Ray &ray, Ray &surface,
-                                              bool topVolume) const {
-  float num[7];
-  float denom[7];
-  float tFar = numeric_limits<float>::max();
-  float tNear = -numeric_limits<float>::max();
-  for (int i = 0; i < 7; i++) {
-    num[i] = glm::dot(normals[i], ray.getPosition());
-    denom[i] = glm::dot(normals[i], ray.getDirection());
-    float tn = (d[i][0] - num[i]) / denom[i];
-    float tf = (d[i][1] - num[i]) / denom[i];
-    if (denom[i] < 0)
-      std::swap(tn, tf);
-    tNear = (tn > tNear) ? tn : tNear;
-    tFar = (tf < tFar) ? tf : tFar;
-    if (tNear > tFar) {
+uint64_t BoundingVolume::closestIntersections(Ray *rays,
+                                              unsigned count) const {
+  if (!isCoherent(rays, count)) {
+    return AccelerationStructure::closestIntersections(rays, count);
+  }
+  return packetClosestIntersection(rays, count);
+}
+
+bool BoundingVolume::isCoherent(const Ray *rays, unsigned count) {
+  for (int axis = 0; axis < 3; axis++) {
+    bool positive = false;
+    bool negative = false;
+    for (unsigned i = 0; i < count; i++) {
+      positive |= rays[i].getDirection()[axis] > 0.0f;
+      negative |= rays[i].getDirection()[axis] < 0.0f;
+    }
+    if (positive && negative) {
       return false;
     }
   }
+  return true;
+}
+
+// the packet is walked depth first, visiting the child nearer along the
+// first ray's direction first; most nodes the whole packet misses are
+// rejected in one test, the rest are entered if any ray still hits them,
+// and the rays before the first one to hit a node are skipped in its
+// subtree, since they missed a node bounding it
+uint64_t BoundingVolume::packetClosestIntersection(Ray *rays,
+                                                   unsigned count) const {
+  if (nodes.empty()) {
+    return 0;
+  }
 
-  // first check the geometry with this volume as direct parent
-  bool anyIntersection = this->anyIntersection(ray, surface);
+  RaySlabs slabs[MAX_PACKET_SIZE];
+  float maxLength = 0.0f;
+  for (unsigned i = 0; i < count; i++) {
+    slabs[i] = RaySlabs(rays[i]);
+    maxLength = std::max(maxLength, rays[i].getLength());
+  }
+  const PacketSlabs packet(slabs, count);
+  const vec3 direction = rays[0].getDirection();
 
-  // then check sub volumes if there are any
-  for (const BoundingVolume &volume : subVolumes) {
-    float lightDistance = ray.getLength();
-    anyIntersection |= volume.calculateIntersection(ray);
-    if (anyIntersection && ray.getCollision() != surface.getCollision() &&
-        ray.getLength() < lightDistance) {
-      break;
+  uint64_t hits = 0;
+
+  struct {
+    unsigned index;
+    unsigned first;
+  } stack[STACK_SIZE];
+  stack[0] = {0, 0};
+  unsigned stackSize = 1;
+
+  while (stackSize > 0) {
+    const auto entry = stack[--stackSize];
+    const Node &node = nodes[entry.index];
+    TraceStats::countNode();
+
+    if (packetMissesNode(node, packet, maxLength)) {
+      continue;
+    }
+
+    float tNear;
+    unsigned first = entry.first;
+    while (first < count &&
+           !intersectsNode(node, slabs[first], rays[first].getLength(),
+                           tNear)) {
+      ++first;
+    }
+    if (first == count) {
+      continue;
+    }
+
+    if (node.isLeaf()) {
+      for (unsigned r = first; r < count; r++) {
+        if (r != first &&
+            !intersectsNode(node, slabs[r], rays[r].getLength(), tNear)) {
+          continue;
+        }
+        TraceStats::countTriangle(node.count);
+        if (packed.calculateIntersection(node.offset, node.count, rays[r])) {
+          hits |= uint64_t(1) << r;
+        }
+      }
+
+      maxLength = 0.0f;
+      for (unsigned r = 0; r < count; r++) {
+        maxLength = std::max(maxLength, rays[r].getLength());
+      }
+      continue;
     }
+
+    // twice the centre of each child's box
+    const Node &left = nodes[node.offset];
+    const Node &right = nodes[node.offset + 1];
+    const vec3 leftCentre(left.d[0][0] + left.d[1][0],
+                          left.d[0][1] + left.d[1][1],
+                          left.d[0][2] + left.d[1][2]);
+    const vec3 rightCentre(right.d[0][0] + right.d[1][0],
+                           right.d[0][1] + right.d[1][1],
+                           right.d[0][2] + right.d[1][2]);
+    const bool rightFirst = glm::dot(direction, rightCentre - leftCentre) < 0;
+
+    stack[stackSize++] = {node.offset + (rightFirst ? 0 : 1), first};
+    stack[stackSize++] = {node.offset + (rightFirst ? 1 : 0), first};
   }
-  if (anyIntersection && topVolume && ray.getCollision()->isMirrored()) {
-    ray.reflect();
 
-    return calculateAnyIntersection(ray, surface, true);
+  return hits;
+}
+
+bool BoundingVolume::sharesOrigin(const Ray *rays, unsigned count) {
+  for (unsigned i = 1; i < count; i++) {
+    if (rays[i].getPosition() != rays[0].getPosition()) {
+      return false;
+    }
   }
+  return true;
+}
 
-  return anyIntersection;
+uint64_t BoundingVolume::anyIntersections(const Ray *rays,
+                                          unsigned count) const {
+  if (!sharesOrigin(rays, count)) {
+    return AccelerationStructure::anyIntersections(rays, count);
+  }
+  return frustumAnyIntersection(rays, count);
 }
 
-bool BoundingVolume::anyIntersection(Ray &ray, Ray &surface) const {
-  bool anyIntersection = false;
-  float lightDistance = ray.getLength();
-  ray.extendToInfinity();
-  for (Ptr_Triangle triangle : triangles) {
-    anyIntersection |= triangle->calculateIntersection(ray);
-    if (anyIntersection && ray.getCollision() != surface.getCollision() &&
-        ray.getLength() < lightDistance) {
-      return anyIntersection;
+// four planes through the shared origin of some rays, leaning out from an
+// axis just far enough to enclose every one of them, with a near plane at
+// the origin and a far plane beyond the end of the longest ray; each plane's
+// normal points inwards
+struct ShadowFrustum {
+  vec3 origin;
+  vec3 normals[6];
+  float offsets[6];
+
+  // false when a ray heads too far from the axis for a frustum to bound the
+  // rays usefully
+  bool fit(const Ray *rays, unsigned count, float minCosine) {
+    origin = rays[0].getPosition();
+
+    vec3 axis(0.0f);
+    for (unsigned i = 0; i < count; i++) {
+      axis += rays[i].getDirection();
+    }
+    if (glm::length(axis) == 0.0f) {
+      return false;
+    }
+    axis = glm::normalize(axis);
+
+    const vec3 u = glm::normalize(std::abs(axis.x) < 0.9f
+                                      ? glm::cross(axis, vec3(1, 0, 0))
+                                      : glm::cross(axis, vec3(0, 1, 0)));
+    const vec3 v = glm::cross(axis, u);
+
+    // the slopes of the rays across the axis are widened slightly, so that
+    // rounding never places a ray outside
+    const float slack = 1e-4f;
+    float uLo = numeric_limits<float>::max(), uHi = -uLo;
+    float vLo = uLo, vHi = uHi;
+    float depth = 0.0f;
+    for (unsigned i = 0; i < count; i++) {
+      const vec3 direction = rays[i].getDirection();
+      const float w = glm::dot(direction, axis);
+      if (w < minCosine * glm::length(direction)) {
+        return false;
+      }
+      uLo = std::min(uLo, glm::dot(direction, u) / w - slack);
+      uHi = std::max(uHi, glm::dot(direction, u) / w + slack);
+      vLo = std::min(vLo, glm::dot(direction, v) / w - slack);
+      vHi = std::max(vHi, glm::dot(direction, v) / w + slack);
+      depth = std::max(depth, w * rays[i].getLength());
+    }
+
+    normals[0] = u - uLo * axis;
+    normals[1] = uHi * axis - u;
+    normals[2] = v - vLo * axis;
+    normals[3] = vHi * axis - v;
+    normals[4] = axis;
+    normals[5] = -axis;
+    for (int plane = 0; plane < 5; plane++) {
+      offsets[plane] = -glm::dot(normals[plane], origin);
     }
+    offsets[5] = glm::dot(axis, origin) + depth * (1.0f + slack);
+    return true;
+  }
+
+  // whether the axis aligned part of the node lies wholly outside a plane,
+  // by testing the corner furthest along the plane's normal
+  bool excludes(const BoundingVolume::Node &node) const {
+    for (int plane = 0; plane < 6; plane++) {
+      const vec3 &normal = normals[plane];
+      const vec3 corner(node.d[normal.x > 0.0f ? 1 : 0][0],
+                        node.d[normal.y > 0.0f ? 1 : 0][1],
+                        node.d[normal.z > 0.0f ? 1 : 0][2]);
+      if (glm::dot(normal, corner) + offsets[plane] < 0.0f) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// the rays walk the nodes together, carrying the mask of rays still to be
+// tested in each subtree; a node outside the frustum is skipped with one test
+// for every ray, the rest are entered by the rays that are not yet blocked
+// and hit them, and the walk ends as soon as every ray is blocked; each ray's
+// far end is left untested as in anyIntersection
+uint64_t BoundingVolume::frustumAnyIntersection(const Ray *rays,
+                                                unsigned count) const {
+  ShadowFrustum frustum;
+  if (count < 2 || nodes.empty() ||
+      !frustum.fit(rays, count, FRUSTUM_MIN_COSINE)) {
+    return AccelerationStructure::anyIntersections(rays, count);
+  }
+
+  Ray segments[MAX_PACKET_SIZE];
+  RaySlabs slabs[MAX_PACKET_SIZE];
+  float maxLength = 0.0f;
+  for (unsigned i = 0; i < count; i++) {
+    segments[i] = shadowSegment(rays[i]);
+    slabs[i] = RaySlabs(segments[i]);
+    maxLength = std::max(maxLength, segments[i].getLength());
+  }
+  const PacketSlabs packet(slabs, count);
+
+  const uint64_t all =
+      (count == 64) ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+  uint64_t blocked = 0;
+
+  unsigned stack[STACK_SIZE];
+  stack[0] = 0;
+  unsigned stackSize = 1;
+
+  while (stackSize > 0 && blocked != all) {
+    const Node &node = nodes[stack[--stackSize]];
+    TraceStats::countNode();
+
+    if (frustum.excludes(node) || packetMissesNode(node, packet, maxLength)) {
+      continue;
+    }
+
+    if (!node.isLeaf()) {
+      stack[stackSize++] = node.offset + 1;
+      stack[stackSize++] = node.offset;
+      continue;
+    }
+
+    for (unsigned r = 0; r < count; r++) {
+      float tNear;
+      if ((blocked >> r & 1) ||
+          !intersectsNode(node, slabs[r], segments[r].getLength(), tNear)) {
+        continue;
+      }
+      TraceStats::countTriangle(node.count);
+      if (packed.calculateAnyIntersection(node.offset, node.count,
+                                          segments[r])) {
+        blocked |= uint64_t(1) << r;
+      }
+    }
+  }
+
+  return blocked;
+}
+
+// mirrors block light like any other triangle
+bool BoundingVolume::anySegmentIntersection(const Ray &segment) const {
+  switch (layout) {
+  case Layout::Wide:
+    return wideAnyIntersection(segment);
+  case Layout::Compressed:
+    return compressedAnyIntersection(segment);
+  case Layout::Stackless:
+    return stacklessAnyIntersection(segment);
+  default:
+    return binaryAnyIntersection(segment);
   }
-  return anyIntersection;
 }
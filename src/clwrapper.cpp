@@ -2,7 +2,7 @@
 #include "clwrapper.h"
 
 
-Accelerator getGPU(int triangleCount) {
+Accelerator getGPU(int triangleCount, int nodeCount) {
 	Accelerator gpu;
 	std::vector<cl::Device> all_devices;
 	std::vector<cl::Platform> all_platforms;
@@ -32,7 +32,8 @@ Accelerator getGPU(int triangleCount) {
 	if (c == 0) {
 		macros = "#define M_PI (float)3.14159265359f  \n";
 	}
-	macros = macros + "#define TRIANGLE_COUNT (int)" + std::to_string(triangleCount);
+	macros = macros + "#define TRIANGLE_COUNT (int)" + std::to_string(triangleCount) +
+		"\n#define NODE_COUNT (int)" + std::to_string(nodeCount);
 
 	gpu.platform.getDevices(CL_DEVICE_TYPE_ALL, &all_devices);
 	c = 0;
@@ -2,7 +2,7 @@
 
 // GlobalIllumination::GlobalIllumination(){};
 
-GlobalIllumination::GlobalIllumination(const Scene &scene, int sampleCount) : LightingEngine(scene.triangles, scene.light), sampleCount(sampleCount), boundingVolume(scene.volume) {};
+GlobalIllumination::GlobalIllumination(const Scene &scene, int sampleCount, const AccelerationStructure *proxyVolume) : LightingEngine(scene.triangles, scene.light), sampleCount(sampleCount), boundingVolume(scene.volume), proxyVolume(proxyVolume) {};
 
 vec3 GlobalIllumination::trace(Ray &ray, int bounces) {
 	// find diffuse light at this position 
@@ -11,13 +11,18 @@ vec3 GlobalIllumination::trace(Ray &ray, int bounces) {
 
 	vector<Ray> rays = light.calculateRays(ray.collisionLocation());
 
+	// only the point the camera sees and the first bounce from it are traced
+	// through the full geometry, as detail further along is blurred away
+	const AccelerationStructure &volume = (bounces < total_bounces && proxyVolume) ? *proxyVolume : boundingVolume;
+
+	TraceStats::setRayType(TraceStats::RayType::Shadow);
+
 	for (int i = 0; i < light.rayCount; i++) {
 		Ray directLightRay = rays[i];
 
-		if (!boundingVolume.calculateAnyIntersection(directLightRay, ray, true)) {
-			lightHere += vec3(0, 0, 0);
-		}
-		else if (directLightRay.getCollision() == ray.getCollision()) {
+		// only the front of a triangle is lit
+		if (glm::dot(ray.collisionFaceNormal(), directLightRay.getDirection()) < 0 &&
+			!volume.calculateAnyIntersection(directLightRay)) {
 			lightHere += light.directLight(directLightRay)*ray.collisionDiffuseColour();
 		}
 	}
@@ -57,8 +62,11 @@ vec3 GlobalIllumination::trace(Ray &ray, int bounces) {
 				sample.x * normalX.z + sample.y * normal.z + sample.z * normalY.z);
 
 			Ray bounce(ray.collisionLocation(), glm::normalize(direction));
+			// the bounce's own shadow rays change the type, so it is set again
+			// for every bounce
+			TraceStats::setRayType(TraceStats::RayType::Bounce);
 			// return this + new collision point 
-			if (boundingVolume.calculateIntersection(bounce)) {
+			if (volume.calculateIntersection(bounce)) {
 				indirectLight += r1 * trace(bounce, bounces - 1);
 			}
 			else {
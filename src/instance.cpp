@@ -0,0 +1,66 @@
+#include "instance.h"
+
+Instance::Instance(const AccelerationStructure &volume,
+                   const Cube &objectBounds, mat3 transform, vec3 translation)
+    : volume(&volume), objectBounds(objectBounds) {
+  setTransform(transform, translation);
+}
+
+void Instance::setTransform(mat3 newTransform, vec3 newTranslation) {
+  transform = newTransform;
+  inverse = glm::inverse(transform);
+  normalTransform = glm::transpose(inverse);
+  translation = newTranslation;
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 minBound(maxFloat, maxFloat, maxFloat);
+  vec3 maxBound(-maxFloat, -maxFloat, -maxFloat);
+
+  for (const vec3 &vertex : getCorners()) {
+    minBound.x = std::min(vertex.x, minBound.x);
+    minBound.y = std::min(vertex.y, minBound.y);
+    minBound.z = std::min(vertex.z, minBound.z);
+    maxBound.x = std::max(vertex.x, maxBound.x);
+    maxBound.y = std::max(vertex.y, maxBound.y);
+    maxBound.z = std::max(vertex.z, maxBound.z);
+  }
+
+  bounds = Cube(minBound, maxBound);
+}
+
+const AccelerationStructure &Instance::getVolume() const { return *volume; }
+
+const Cube &Instance::getBounds() const { return bounds; }
+
+vector<vec3> Instance::getCorners() const {
+  vector<vec3> corners;
+  for (int corner = 0; corner < 8; ++corner) {
+    corners.push_back(toWorld(vec3(
+        (corner & 1) ? objectBounds.b.x : objectBounds.a.x,
+        (corner & 2) ? objectBounds.b.y : objectBounds.a.y,
+        (corner & 4) ? objectBounds.b.z : objectBounds.a.z)));
+  }
+  return corners;
+}
+
+vec3 Instance::toWorld(vec3 position) const {
+  return transform * position + translation;
+}
+
+vec3 Instance::normalToWorld(vec3 normal) const {
+  return normalize(normalTransform * normal);
+}
+
+Ray Instance::toObject(const Ray &ray, float &scale) const {
+  vec3 direction = inverse * ray.getDirection();
+  scale = glm::length(direction);
+
+  float length = ray.getLength();
+  if (length < numeric_limits<float>::max() / scale) {
+    length *= scale;
+  } else {
+    length = numeric_limits<float>::max();
+  }
+
+  return Ray(inverse * (ray.getPosition() - translation), direction, length);
+}
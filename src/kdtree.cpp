@@ -0,0 +1,311 @@
+#include "kdtree.h"
+
+#include <cmath>
+
+static float surfaceArea(vec3 min, vec3 max) {
+  vec3 extent = max - min;
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z +
+                 extent.z * extent.x);
+}
+
+// reciprocal that stays finite for directions parallel to an axis
+static float reciprocal(float x) {
+  const float minimum = 1e-20f;
+  if (std::abs(x) < minimum) {
+    x = (x < 0.0f) ? -minimum : minimum;
+  }
+  return 1.0f / x;
+}
+
+static size_t countBelow(const vector<float> &sorted, float value) {
+  return std::lower_bound(sorted.begin(), sorted.end(), value) -
+         sorted.begin();
+}
+
+static size_t countAbove(const vector<float> &sorted, float value) {
+  return sorted.end() -
+         std::upper_bound(sorted.begin(), sorted.end(), value);
+}
+
+KdTree::KdTree(const Ptr_Triangles &triangles) : min(), max() {
+  if (triangles.empty()) {
+    return;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  min = vec3(maxFloat, maxFloat, maxFloat);
+  max = vec3(-maxFloat, -maxFloat, -maxFloat);
+
+  vector<vec3> triangleMin, triangleMax;
+  vector<unsigned> references;
+  for (const Ptr_Triangle &triangle : triangles) {
+    triangleMin.push_back(
+        glm::min(glm::min(triangle->v0, triangle->v1), triangle->v2));
+    triangleMax.push_back(
+        glm::max(glm::max(triangle->v0, triangle->v1), triangle->v2));
+    min = glm::min(min, triangleMin.back());
+    max = glm::max(max, triangleMax.back());
+    references.push_back(static_cast<unsigned>(references.size()));
+  }
+
+  nodes.emplace_back();
+  build(0, references, min, max, triangleMin, triangleMax, triangles, 0);
+
+  const unsigned ropes[6] = {NONE, NONE, NONE, NONE, NONE, NONE};
+  attachRopes(0, ropes);
+
+  packed = PackedTriangles(this->triangles);
+}
+
+const vector<KdTree::Node> &KdTree::getNodes() const { return nodes; }
+
+const vector<KdTree::Leaf> &KdTree::getLeaves() const { return leaves; }
+
+const Ptr_Triangles &KdTree::getTriangles() const { return triangles; }
+
+// every plane through a side of a triangle's box, clipped to the node, is
+// tried along each axis; the triangles on each side of a plane are counted by
+// binary searches over the sorted sides, and a triangle lying in the plane is
+// put on both sides
+void KdTree::build(unsigned index, vector<unsigned> &references, vec3 min,
+                   vec3 max, const vector<vec3> &triangleMin,
+                   const vector<vec3> &triangleMax, const Ptr_Triangles &input,
+                   unsigned depth) {
+  const size_t count = references.size();
+  const float area = surfaceArea(min, max);
+  // deeper trees stop paying for themselves, however the costs look
+  const unsigned maxDepth = static_cast<unsigned>(
+      8.0f + 1.3f * std::log2(static_cast<float>(input.size())));
+
+  float bestCost = INTERSECTION_COST * count;
+  int bestAxis = -1;
+  float bestSplit = 0.0f;
+
+  const bool splittable = depth < maxDepth && count > 1 && area > 0.0f;
+
+  for (int axis = 0; splittable && axis < 3; axis++) {
+    if (max[axis] <= min[axis]) {
+      continue;
+    }
+
+    vector<float> starts, ends, planar;
+    for (unsigned reference : references) {
+      float lo = std::max(triangleMin[reference][axis], min[axis]);
+      float hi = std::min(triangleMax[reference][axis], max[axis]);
+      if (lo == hi) {
+        planar.push_back(lo);
+      } else {
+        starts.push_back(lo);
+        ends.push_back(hi);
+      }
+    }
+    std::sort(starts.begin(), starts.end());
+    std::sort(ends.begin(), ends.end());
+    std::sort(planar.begin(), planar.end());
+
+    for (const vector<float> *candidates : {&starts, &ends, &planar}) {
+      for (float split : *candidates) {
+        if (split <= min[axis] || split >= max[axis]) {
+          continue;
+        }
+
+        size_t left = countBelow(starts, split) + planar.size() -
+                      countAbove(planar, split);
+        size_t right = countAbove(ends, split) + planar.size() -
+                       countBelow(planar, split);
+
+        vec3 leftMax = max;
+        leftMax[axis] = split;
+        vec3 rightMin = min;
+        rightMin[axis] = split;
+
+        float cost =
+            TRAVERSAL_COST +
+            INTERSECTION_COST *
+                (surfaceArea(min, leftMax) * left +
+                 surfaceArea(rightMin, max) * right) /
+                area;
+        if (left == 0 || right == 0) {
+          cost *= 1.0f - EMPTY_BONUS;
+        }
+
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = split;
+        }
+      }
+    }
+  }
+
+  if (bestAxis == -1) {
+    nodes[index] = {0.0f, LEAF, static_cast<unsigned>(leaves.size())};
+
+    Leaf leaf = {min, max, static_cast<unsigned>(triangles.size()),
+                 static_cast<unsigned>(count), {}};
+    leaves.push_back(leaf);
+    for (unsigned reference : references) {
+      triangles.push_back(input[reference]);
+    }
+    return;
+  }
+
+  vector<unsigned> left, right;
+  for (unsigned reference : references) {
+    float lo = std::max(triangleMin[reference][bestAxis], min[bestAxis]);
+    float hi = std::min(triangleMax[reference][bestAxis], max[bestAxis]);
+    if (lo < bestSplit || (lo == hi && lo == bestSplit)) {
+      left.push_back(reference);
+    }
+    if (hi > bestSplit || (lo == hi && hi == bestSplit)) {
+      right.push_back(reference);
+    }
+  }
+  vector<unsigned>().swap(references);
+
+  const unsigned first = static_cast<unsigned>(nodes.size());
+  nodes[index] = {bestSplit, static_cast<unsigned>(bestAxis), first};
+  nodes.emplace_back();
+  nodes.emplace_back();
+
+  vec3 leftMax = max;
+  leftMax[bestAxis] = bestSplit;
+  vec3 rightMin = min;
+  rightMin[bestAxis] = bestSplit;
+
+  build(first, left, min, leftMax, triangleMin, triangleMax, input,
+        depth + 1);
+  build(first + 1, right, rightMin, max, triangleMin, triangleMax, input,
+        depth + 1);
+}
+
+// the two children of a node are each other's neighbours across its plane,
+// and share its neighbours everywhere else; a leaf's ropes are then pushed
+// down to the smallest node that still covers the whole face, so that fewer
+// nodes are descended through after following one
+void KdTree::attachRopes(unsigned index, const unsigned ropes[6]) {
+  const Node &node = nodes[index];
+  if (node.axis == LEAF) {
+    Leaf &leaf = leaves[node.offset];
+    for (unsigned face = 0; face < 6; face++) {
+      unsigned rope = ropes[face];
+      while (rope != NONE && nodes[rope].axis != LEAF) {
+        const Node &neighbour = nodes[rope];
+        if (neighbour.axis == face / 2) {
+          // the neighbour's child facing this leaf
+          rope = neighbour.offset + ((face & 1) ? 0 : 1);
+        } else if (neighbour.split <= leaf.min[neighbour.axis]) {
+          rope = neighbour.offset + 1;
+        } else if (neighbour.split >= leaf.max[neighbour.axis]) {
+          rope = neighbour.offset;
+        } else {
+          break;
+        }
+      }
+      leaf.ropes[face] = rope;
+    }
+    return;
+  }
+
+  unsigned childRopes[6];
+  std::copy(ropes, ropes + 6, childRopes);
+  childRopes[2 * node.axis + 1] = node.offset + 1;
+  attachRopes(node.offset, childRopes);
+
+  std::copy(ropes, ropes + 6, childRopes);
+  childRopes[2 * node.axis] = node.offset;
+  attachRopes(node.offset + 1, childRopes);
+}
+
+// a point on a plane belongs to the side the ray is heading into
+unsigned KdTree::findLeaf(unsigned index, vec3 point, vec3 direction) const {
+  while (nodes[index].axis != LEAF) {
+    const Node &node = nodes[index];
+    float position = point[node.axis];
+    bool right = position > node.split ||
+                 (position == node.split && direction[node.axis] > 0.0f);
+    index = node.offset + (right ? 1 : 0);
+  }
+  return nodes[index].offset;
+}
+
+// leaves the current leaf through the nearest face ahead of the ray and
+// follows that face's rope down to the leaf on the other side; the point the
+// ray crosses is snapped onto the face, so that it is never found back in
+// the leaf it just left
+template <typename Visit>
+void KdTree::walk(const Ray &ray, Visit visit) const {
+  if (nodes.empty()) {
+    return;
+  }
+
+  const vec3 position = ray.getPosition();
+  const vec3 direction = ray.getDirection();
+  const vec3 inverse(reciprocal(direction.x), reciprocal(direction.y),
+                     reciprocal(direction.z));
+
+  float tEntry = 0.0f;
+  float tExit = ray.getLength();
+  for (int axis = 0; axis < 3; axis++) {
+    float t0 = (min[axis] - position[axis]) * inverse[axis];
+    float t1 = (max[axis] - position[axis]) * inverse[axis];
+    tEntry = std::max(tEntry, std::min(t0, t1));
+    tExit = std::min(tExit, std::max(t0, t1));
+  }
+  if (tEntry > tExit) {
+    return;
+  }
+
+  unsigned leafIndex = findLeaf(0, position + tEntry * direction, direction);
+  while (true) {
+    const Leaf &leaf = leaves[leafIndex];
+    TraceStats::countNode();
+
+    int face = -1;
+    float tLeafExit = numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+      if (direction[axis] == 0.0f) {
+        continue;
+      }
+      bool positive = direction[axis] > 0.0f;
+      float plane = positive ? leaf.max[axis] : leaf.min[axis];
+      float t = (plane - position[axis]) * inverse[axis];
+      if (t < tLeafExit) {
+        tLeafExit = t;
+        face = 2 * axis + (positive ? 1 : 0);
+      }
+    }
+
+    if (visit(leaf, tLeafExit) || tLeafExit >= tExit || face == -1 ||
+        leaf.ropes[face] == NONE) {
+      return;
+    }
+
+    vec3 point = position + tLeafExit * direction;
+    point[face / 2] = (face & 1) ? leaf.max[face / 2] : leaf.min[face / 2];
+    leafIndex = findLeaf(leaf.ropes[face], point, direction);
+  }
+}
+
+// a triangle may reach beyond the leaf it was found in, so the walk only
+// stops once the closest hit is no further than the leaf's far side
+bool KdTree::closestIntersection(Ray &ray) const {
+  bool anyIntersection = false;
+  walk(ray, [&](const Leaf &leaf, float tLeafExit) {
+    TraceStats::countTriangle(leaf.count);
+    anyIntersection |=
+        packed.calculateIntersection(leaf.first, leaf.count, ray);
+    return anyIntersection && ray.getLength() <= tLeafExit;
+  });
+  return anyIntersection;
+}
+
+bool KdTree::anySegmentIntersection(const Ray &segment) const {
+  bool blocked = false;
+  walk(segment, [&](const Leaf &leaf, float) {
+    TraceStats::countTriangle(leaf.count);
+    blocked = packed.calculateAnyIntersection(leaf.first, leaf.count, segment);
+    return blocked;
+  });
+  return blocked;
+}
@@ -20,6 +20,15 @@ bool Light::update(float dt) {
   return false;
 }
 
+vector<Ray> Light::calculateRays(vec3 target) const {
+  vector<Ray> rays;
+  rays.reserve(rayCount);
+  for (int i = 0; i < rayCount; i++) {
+    rays.push_back(calculateRay(target));
+  }
+  return rays;
+}
+
 vec3 Light::directLight(const Ray &ray) const {
   return colour * power / (4.0f * (static_cast<float>(M_PI)) * ray.getLength() *
                            ray.getLength());
@@ -5,3 +5,14 @@ LightingEngine::LightingEngine(const Ptr_Triangles &triangles,
     : triangles(triangles), light(light){};
 
 LightingEngine::~LightingEngine() {}
+
+vec3 LightingEngine::calculateLights(Ray *cameraRays, unsigned count,
+                                     uint64_t hits, ivec2 pixel) {
+  vec3 lightColour(0, 0, 0);
+  for (unsigned k = 0; k < count; k++) {
+    if (hits & (uint64_t(1) << k)) {
+      lightColour += calculateLight(cameraRays[k], pixel);
+    }
+  }
+  return lightColour;
+}
@@ -1,15 +1,22 @@
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
+#include <set>
 #include <string>
 
+#include "benchmark.h"
 #include "flatlighting.h"
+#include "kdtree.h"
 #include "objects.h"
+#include "proxyvolume.h"
 #include "rasteriser.h"
 #include "rastlighting.h"
 #include "raytracer.h"
 #include "standardlighting.h"
 #include "starscreen.h"
 #include "terrain_gen.h"
+#include "toplevelvolume.h"
+#include "uniformgrid.h"
 
 #ifdef useCL
 #include "raytracer_cl.h"
@@ -32,15 +39,93 @@ int main(int argc, char *argv[]) {
 
     if (argc >= 3 && string(argv[2]) == "teapot") {
       object = new Teapot();
+    } else if (argc >= 3 && string(argv[2]) == "capsule") {
+      object = new Capsule();
+    } else if (argc >= 3 && string(argv[2]) == "terrain") {
+      object = new Terrain();
     } else {
       object = new Box;
     }
 
+    // options following the object's name
+    std::set<string> options(argv + std::min(argc, 3), argv + argc);
+
+    // each object is traced through what suits it, unless told otherwise
+    if (options.count("bvh") != 0) {
+      object->setBackend(Object::Backend::BoundingVolume);
+    } else if (options.count("kdtree") != 0) {
+      object->setBackend(Object::Backend::KdTree);
+    } else if (options.count("grid") != 0) {
+      object->setBackend(Object::Backend::Grid);
+    }
+    Object::Backend backend = object->getBackend();
+
+    // the layout of the bounding volume's nodes, four wide unless told
+    // otherwise
+    BoundingVolume::Layout layout = BoundingVolume::Layout::Wide;
+    if (options.count("binary") != 0) {
+      layout = BoundingVolume::Layout::Binary;
+    } else if (options.count("compressed") != 0) {
+      layout = BoundingVolume::Layout::Compressed;
+    } else if (options.count("stackless") != 0) {
+      layout = BoundingVolume::Layout::Stackless;
+    }
+
     Ptr_Triangles geometry = object->allTriangles();
 
-    BoundingVolume bvh = object->createBoundingVolume();
+    // the bounding volume is only built, and cached, for what traces through
+    // it rather than through the kd-tree or the grid: the benchmarks and
+    // OpenCL's stackless nodes as well as its own backend
+    bool useBvh = backend == Object::Backend::BoundingVolume ||
+                  mode == "bench" || mode == "cl";
+    BoundingVolume bvh = useBvh ? object->createBoundingVolume()
+                                : BoundingVolume(Ptr_Triangles());
+    bvh.setLayout(layout);
+#ifdef TRACE_STATS
+    if (useBvh) {
+      Benchmark::printStatistics(bvh);
+    }
+#endif
 
-    Cube bounds(geometry);
+    KdTree kdTree(backend == Object::Backend::KdTree ? geometry
+                                                      : Ptr_Triangles());
+    UniformGrid grid(backend == Object::Backend::Grid ? geometry
+                                                       : Ptr_Triangles());
+    const AccelerationStructure *objectVolume = &bvh;
+    if (backend == Object::Backend::KdTree) {
+      objectVolume = &kdTree;
+    } else if (backend == Object::Backend::Grid) {
+      objectVolume = &grid;
+    }
+
+    Cube objectBounds(geometry);
+    Cube bounds = objectBounds;
+
+    // a thousand copies of the object sharing its triangles and hierarchy
+    bool instanced = options.count("instanced") != 0;
+    TopLevelVolume copies(
+        instanced ? TopLevelVolume::grid(*objectVolume, objectBounds, 10)
+                  : vector<Instance>());
+    const AccelerationStructure *volume = objectVolume;
+    if (instanced) {
+      bounds = copies.getBounds();
+      volume = &copies;
+    }
+
+    // decimated geometry for global illumination's later bounces, copied
+    // like the object when it is instanced
+    bool proxy = options.count("proxy") != 0;
+    ProxyVolume proxyObject(proxy ? geometry : Ptr_Triangles());
+    TopLevelVolume proxyCopies(
+        proxy && instanced
+            ? TopLevelVolume::grid(proxyObject, objectBounds, 10)
+            : vector<Instance>());
+    const AccelerationStructure *proxyVolume = nullptr;
+    if (proxy) {
+      proxyVolume = instanced ? static_cast<const AccelerationStructure *>(
+                                    &proxyCopies)
+                              : &proxyObject;
+    }
 
     vec3 lightPosition = lerpV(bounds.a, bounds.b, vec3(0.8, 0.8, 0.1));
 
@@ -52,8 +137,8 @@ int main(int argc, char *argv[]) {
     SphereLight softLight(lightPosition, bounds, 5.0f, lightColour, lightPower,
                           4.0f, 5);
 
-    Scene scene_low_quality = {light, geometry, bvh, bounds};
-    Scene scene = {softLight, geometry, bvh, bounds};
+    Scene scene_low_quality = {light, geometry, *volume, bounds};
+    Scene scene = {softLight, geometry, *volume, bounds};
 
     float viewAngle = 30.0f;
 
@@ -66,6 +151,15 @@ int main(int argc, char *argv[]) {
       }
     }
 
+    if (mode == "bench") {
+      Benchmark benchmark(geometry, objectBounds);
+      benchmark.run(bvh);
+
+      delete object;
+
+      return EXIT_SUCCESS;
+    }
+
     SdlScreen *screen = nullptr;
     LightingEngine *engine = nullptr;
 
@@ -82,7 +176,8 @@ int main(int argc, char *argv[]) {
       screen = new Rasteriser(500, 500, viewAngle, *engine, scene_low_quality);
     } else if (mode == "gi") {
       int sampleCount = 1;
-      engine = new GlobalIllumination(scene_low_quality, sampleCount);
+      engine =
+          new GlobalIllumination(scene_low_quality, sampleCount, proxyVolume);
       screen =
           new RayTracer(500, 500, viewAngle, 4, *engine, scene_low_quality);
     } else if (mode == "conv") {
@@ -120,9 +215,16 @@ int main(int argc, char *argv[]) {
     cout << "\trast - rasterizer" << endl;
     cout << "\tgi - global illumination" << endl;
     cout << "\tconv - convergent global illumination" << endl;
+    cout << "\tbench - acceleration structure benchmarks" << endl;
 #ifdef useCL
     cout << "\tcl - openCL raytracer" << endl;
 #endif
+    cout << "followed by box, teapot, capsule or terrain, then bvh, kdtree or "
+            "grid to choose what to trace it through, binary, wide, "
+            "compressed or stackless to choose the bvh's layout, instanced "
+            "for a grid of copies and proxy for simplified geometry behind "
+            "gi's later bounces"
+         << endl;
 
     return EXIT_FAILURE;
   }
@@ -45,7 +45,7 @@ void Object::readGroup(FILE *file) {
 
   string groupName = readString(file);
 
-  groups.emplace(groupName, Ptr_Triangles());
+  groups.emplace(groupName, vector<Triangle *>());
 
   unsigned faceCount = readCount(file);
 
@@ -169,11 +169,9 @@ vec3 Object::readVec3(FILE *file) {
   return vec3(x, y, z);
 }
 
-BoundingVolume Object::getBoundingVolume(string groupName) {
-  return BoundingVolume(groups[groupName]);
-}
-
 void Object::load(string fileName) {
+  this->fileName = fileName;
+
   FILE *file = fopen(fileName.data(), "r");
 
   readMaterials(file);
@@ -182,7 +180,23 @@ void Object::load(string fileName) {
   fclose(file);
 }
 
-Object::Object() { materials.emplace("", new Material()); }
+const Material *Object::addMaterial(const string &name, Material *material) {
+  delete materials[name];
+  materials[name] = material;
+  return material;
+}
+
+void Object::addTriangles(const string &groupName,
+                          const vector<Triangle *> &triangles) {
+  vector<Triangle *> &group = groups[groupName];
+  group.insert(group.end(), triangles.begin(), triangles.end());
+}
+
+Object::Object()
+    : buildMode(BoundingVolume::BuildMode::Binned),
+      backend(Backend::BoundingVolume) {
+  materials.emplace("", new Material());
+}
 
 Object::~Object() {
   for (const auto &group : groups) {
@@ -205,3 +219,29 @@ Ptr_Triangles Object::allTriangles() {
 
   return triangles;
 }
+
+vector<Triangle *> Object::allMutableTriangles() {
+  vector<Triangle *> triangles;
+
+  for (const auto &group : groups) {
+    triangles.insert(triangles.end(), group.second.begin(), group.second.end());
+  }
+
+  return triangles;
+}
+
+void Object::setBuildMode(BoundingVolume::BuildMode mode) {
+  buildMode = mode;
+}
+
+Object::Backend Object::getBackend() const { return backend; }
+
+void Object::setBackend(Backend backend) { this->backend = backend; }
+
+BoundingVolume Object::createBoundingVolume() {
+  if (fileName.empty()) {
+    return BoundingVolume(allTriangles(), buildMode);
+  }
+
+  return BoundingVolume(allTriangles(), fileName + ".bvh", buildMode);
+}
@@ -1,16 +1,25 @@
 #include "objects.h"
 
-Box::Box() { load("obj-converter/box.sobj"); }
+#include "terrain_gen.h"
 
-BoundingVolume Box::createBoundingVolume() {
-  BoundingVolume room = getBoundingVolume("room");
-
-  room.setSubVolume(getBoundingVolume("short"));
-  room.setSubVolume(getBoundingVolume("tall"));
-
-  return room;
+// the room is static and its walls are a few large triangles, so the slower
+// spatial split build pays for itself
+Box::Box() {
+  load("obj-converter/box.sobj");
+  buildMode = BoundingVolume::BuildMode::Spatial;
 }
 
 Teapot::Teapot() { load("obj-converter/teapot.sobj"); }
 
-BoundingVolume Teapot::createBoundingVolume() { return getBoundingVolume(""); }
+Capsule::Capsule() { load("obj-converter/capsule.sobj"); }
+
+// evenly spread triangles are found quickest through a grid
+Terrain::Terrain(float width, int maxHeight, int resolution) {
+  const Material *grass = addMaterial(
+      "grass", new Material(vec3(0.05f, 0.1f, 0.05f), vec3(0.3f, 0.6f, 0.2f),
+                            vec3(0.1f, 0.1f, 0.1f), 10, false, false));
+  TerrainGenerator generator;
+  addTriangles("terrain", generator.generateTerrain(width, maxHeight,
+                                                    resolution, vec3(), grass));
+  backend = Backend::Grid;
+}
@@ -0,0 +1,134 @@
+#include "packedtriangles.h"
+
+PackedTriangles::PackedTriangles() {}
+
+PackedTriangles::PackedTriangles(const Ptr_Triangles &triangles)
+    : triangles(triangles) {
+  for (int axis = 0; axis < 3; axis++) {
+    v0[axis].reserve(triangles.size() + PADDING);
+    e1[axis].reserve(triangles.size() + PADDING);
+    e2[axis].reserve(triangles.size() + PADDING);
+    for (const Ptr_Triangle &triangle : triangles) {
+      v0[axis].push_back(triangle->v0[axis]);
+      e1[axis].push_back(triangle->e1[axis]);
+      e2[axis].push_back(triangle->e2[axis]);
+    }
+    v0[axis].resize(triangles.size() + PADDING, 0.0f);
+    e1[axis].resize(triangles.size() + PADDING, 0.0f);
+    e2[axis].resize(triangles.size() + PADDING, 0.0f);
+  }
+}
+
+size_t PackedTriangles::size() const { return triangles.size(); }
+
+// cross and dot products are written out lane by lane in the order glm
+// takes them, so that each lane finds the same hits as the scalar test
+int PackedTriangles::intersectFour(size_t first, size_t count,
+                                   const __m128 position[3],
+                                   const __m128 direction[3], float length,
+                                   __m128 &t, __m128 &u, __m128 &v) const {
+  __m128 edge1[3], edge2[3], b[3];
+  for (int axis = 0; axis < 3; axis++) {
+    edge1[axis] = _mm_loadu_ps(e1[axis].data() + first);
+    edge2[axis] = _mm_loadu_ps(e2[axis].data() + first);
+    b[axis] =
+        _mm_sub_ps(position[axis], _mm_loadu_ps(v0[axis].data() + first));
+  }
+
+  auto cross = [](const __m128 x[3], const __m128 y[3], __m128 out[3]) {
+    out[0] = _mm_sub_ps(_mm_mul_ps(x[1], y[2]), _mm_mul_ps(x[2], y[1]));
+    out[1] = _mm_sub_ps(_mm_mul_ps(x[2], y[0]), _mm_mul_ps(x[0], y[2]));
+    out[2] = _mm_sub_ps(_mm_mul_ps(x[0], y[1]), _mm_mul_ps(x[1], y[0]));
+  };
+  auto dot = [](const __m128 x[3], const __m128 y[3]) {
+    return _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(x[0], y[0]), _mm_mul_ps(x[1], y[1])),
+        _mm_mul_ps(x[2], y[2]));
+  };
+
+  __m128 p[3], q[3];
+  cross(direction, edge2, p);
+  cross(b, edge1, q);
+  const __m128 det = dot(edge1, p);
+  const __m128 uDet = dot(b, p);
+  const __m128 vDet = dot(direction, q);
+  const __m128 tDet = dot(edge2, q);
+
+  const __m128 zero = _mm_setzero_ps();
+  __m128 hit = _mm_cmplt_ps(det, zero);
+  hit = _mm_and_ps(hit, _mm_cmple_ps(uDet, zero));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(uDet, det));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(vDet, zero));
+  hit = _mm_and_ps(hit, _mm_cmpgt_ps(_mm_add_ps(uDet, vDet), det));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(tDet, zero));
+
+  int mask = _mm_movemask_ps(hit) & ((1 << std::min<size_t>(count, 4)) - 1);
+  if (mask == 0) {
+    return 0;
+  }
+
+  // lanes that missed may divide by zero, but are masked out
+  const __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+  t = _mm_mul_ps(tDet, inverse);
+  u = _mm_mul_ps(uDet, inverse);
+  v = _mm_mul_ps(vDet, inverse);
+  return mask & _mm_movemask_ps(_mm_cmplt_ps(t, _mm_set1_ps(length)));
+}
+
+// within four lanes the nearest hit is taken, the first of any that tie, as
+// the scalar loop would have kept it
+bool PackedTriangles::calculateIntersection(size_t first, size_t count,
+                                            Ray &ray) const {
+  const vec3 origin = ray.getPosition();
+  const vec3 heading = ray.getDirection();
+  const __m128 position[3] = {_mm_set1_ps(origin.x), _mm_set1_ps(origin.y),
+                              _mm_set1_ps(origin.z)};
+  const __m128 direction[3] = {_mm_set1_ps(heading.x),
+                               _mm_set1_ps(heading.y),
+                               _mm_set1_ps(heading.z)};
+
+  bool anyIntersection = false;
+  for (size_t i = first; i < first + count; i += 4) {
+    __m128 t, u, v;
+    const int mask = intersectFour(i, first + count - i, position, direction,
+                                   ray.getLength(), t, u, v);
+    if (mask == 0) {
+      continue;
+    }
+
+    alignas(16) float ts[4], us[4], vs[4];
+    _mm_store_ps(ts, t);
+    _mm_store_ps(us, u);
+    _mm_store_ps(vs, v);
+    int nearest = -1;
+    for (int lane = 0; lane < 4; lane++) {
+      if ((mask >> lane & 1) && (nearest == -1 || ts[lane] < ts[nearest])) {
+        nearest = lane;
+      }
+    }
+    ray.updateCollision(triangles[i + nearest], ts[nearest],
+                        vec2(us[nearest], vs[nearest]));
+    anyIntersection = true;
+  }
+  return anyIntersection;
+}
+
+bool PackedTriangles::calculateAnyIntersection(size_t first, size_t count,
+                                               const Ray &ray) const {
+  const vec3 origin = ray.getPosition();
+  const vec3 heading = ray.getDirection();
+  const __m128 position[3] = {_mm_set1_ps(origin.x), _mm_set1_ps(origin.y),
+                              _mm_set1_ps(origin.z)};
+  const __m128 direction[3] = {_mm_set1_ps(heading.x),
+                               _mm_set1_ps(heading.y),
+                               _mm_set1_ps(heading.z)};
+
+  for (size_t i = first; i < first + count; i += 4) {
+    __m128 t, u, v;
+    if (intersectFour(i, first + count - i, position, direction,
+                      ray.getLength(), t, u, v) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,132 @@
+#include "proxyvolume.h"
+
+#include <array>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+
+ProxyVolume::ProxyVolume(const Ptr_Triangles &triangles, unsigned resolution)
+    : cellSize(findCellSize(triangles, resolution)),
+      proxyTriangles(decimate(triangles)),
+      volume(Ptr_Triangles(proxyTriangles.begin(), proxyTriangles.end())) {
+  volume.setLayout(BoundingVolume::Layout::Wide);
+}
+
+ProxyVolume::~ProxyVolume() {
+  for (Triangle *triangle : proxyTriangles) {
+    delete triangle;
+  }
+}
+
+float ProxyVolume::findCellSize(const Ptr_Triangles &triangles,
+                                unsigned resolution) {
+  if (triangles.empty()) {
+    return 1.0f;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 min(maxFloat, maxFloat, maxFloat);
+  vec3 max(-maxFloat, -maxFloat, -maxFloat);
+  for (const Ptr_Triangle &triangle : triangles) {
+    min = glm::min(min, glm::min(glm::min(triangle->v0, triangle->v1),
+                                 triangle->v2));
+    max = glm::max(max, glm::max(glm::max(triangle->v0, triangle->v1),
+                                 triangle->v2));
+  }
+
+  const vec3 extent = max - min;
+  const float widest = std::max(std::max(extent.x, extent.y), extent.z);
+  return (widest > 0.0f) ? widest / std::max(resolution, 1u) : 1.0f;
+}
+
+// vertices are clustered by the cell they fall in, each cluster moving to its
+// average; triangles with two corners in one cell vanish, and of triangles
+// joining the same three cells only the first is kept
+vector<Triangle *>
+ProxyVolume::decimate(const Ptr_Triangles &triangles) const {
+  auto cellOf = [this](vec3 vertex) {
+    const int64_t range = 1 << 20;
+    int64_t key = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      int64_t cell =
+          static_cast<int64_t>(std::floor(vertex[axis] / cellSize)) +
+          range / 2;
+      key = key * range + std::min(std::max(cell, int64_t(0)), range - 1);
+    }
+    return key;
+  };
+
+  struct Cluster {
+    vec3 sum;
+    unsigned count;
+  };
+  std::unordered_map<int64_t, Cluster> clusters;
+  for (const Ptr_Triangle &triangle : triangles) {
+    for (const vec3 &vertex : {triangle->v0, triangle->v1, triangle->v2}) {
+      Cluster &cluster = clusters[cellOf(vertex)];
+      cluster.sum += vertex;
+      ++cluster.count;
+    }
+  }
+
+  vector<Triangle *> decimated;
+  std::set<std::array<int64_t, 3>> joined;
+  for (const Ptr_Triangle &triangle : triangles) {
+    std::array<int64_t, 3> cells = {
+        {cellOf(triangle->v0), cellOf(triangle->v1), cellOf(triangle->v2)}};
+    if (cells[0] == cells[1] || cells[1] == cells[2] ||
+        cells[2] == cells[0]) {
+      continue;
+    }
+
+    vec3 corners[3];
+    for (int i = 0; i < 3; i++) {
+      const Cluster &cluster = clusters[cells[i]];
+      corners[i] = cluster.sum / static_cast<float>(cluster.count);
+    }
+
+    std::sort(cells.begin(), cells.end());
+    if (!joined.insert(cells).second) {
+      continue;
+    }
+
+    decimated.push_back(new Triangle(corners[0], corners[1], corners[2],
+                                     triangle->vt0, triangle->vt1,
+                                     triangle->vt2, triangle->mat));
+  }
+  return decimated;
+}
+
+Ptr_Triangles ProxyVolume::getTriangles() const {
+  return Ptr_Triangles(proxyTriangles.begin(), proxyTriangles.end());
+}
+
+float ProxyVolume::getTolerance() const {
+  return std::sqrt(3.0f) * cellSize;
+}
+
+bool ProxyVolume::closestIntersection(Ray &ray) const {
+  const float tolerance = getTolerance();
+  if (ray.getLength() <= tolerance) {
+    return false;
+  }
+
+  Ray skipped(ray.getPosition() + tolerance * ray.getDirection(),
+              ray.getDirection(), ray.getLength() - tolerance);
+  if (!volume.closestIntersection(skipped)) {
+    return false;
+  }
+  ray.updateCollision(skipped);
+  return true;
+}
+
+bool ProxyVolume::anySegmentIntersection(const Ray &segment) const {
+  const float tolerance = getTolerance();
+  if (segment.getLength() <= tolerance) {
+    return false;
+  }
+
+  return volume.anySegmentIntersection(Ray(segment.getPosition(),
+                                           segment.getDirection(),
+                                           segment.getLength() - tolerance));
+}
@@ -1,14 +1,18 @@
 #include "ray.h"
 
+#include "instance.h"
+
 Ray::Ray() : Ray(vec3(), vec3()){};
 
 Ray::Ray(vec3 initPosition, vec3 initDirection, float initLength)
     : position(initPosition), direction(normalize(initDirection)),
-      length(initLength), coordinate(Coordinate::None), collision(nullptr) {}
+      length(initLength), coordinate(Coordinate::None), collision(nullptr),
+      instance(nullptr) {}
 
 Ray::Ray(const Ray &other)
     : position(other.position), direction(other.direction),
-      length(other.length), coordinate(other.coordinate) {
+      length(other.length), coordinate(other.coordinate),
+      collision(other.collision), instance(other.instance) {
   switch (coordinate) {
   case Coordinate::UV:
     uv = other.uv;
@@ -33,6 +37,7 @@ Triangle const *Ray::getCollision() const { return collision; }
 
 void Ray::updateCollision(Triangle const *newCollision, float newLength) {
   collision = newCollision;
+  instance = nullptr;
   length = newLength;
   coordinate = Coordinate::None;
 }
@@ -40,6 +45,7 @@ void Ray::updateCollision(Triangle const *newCollision, float newLength) {
 void Ray::updateCollision(Triangle const *newCollision, float newLength,
                           vec2 newUV) {
   collision = newCollision;
+  instance = nullptr;
   length = newLength;
   coordinate = Coordinate::UV;
   uv = newUV;
@@ -48,13 +54,33 @@ void Ray::updateCollision(Triangle const *newCollision, float newLength,
 void Ray::updateCollision(Triangle const *newCollision, float newLength,
                           vec3 newBary) {
   collision = newCollision;
+  instance = nullptr;
   length = newLength;
   coordinate = Coordinate::BARY;
   bary = newBary;
 }
 
+void Ray::updateCollision(const Ray &objectRay, Instance const *newInstance,
+                          float newLength) {
+  collision = objectRay.collision;
+  instance = newInstance;
+  length = newLength;
+  coordinate = objectRay.coordinate;
+  switch (coordinate) {
+  case Coordinate::UV:
+    uv = objectRay.uv;
+    break;
+  case Coordinate::BARY:
+    bary = objectRay.bary;
+    break;
+  default:
+    break;
+  }
+}
+
 void Ray::updateCollision(const Ray &other) {
   collision = other.collision;
+  instance = other.instance;
   length = distance(position, other.collisionLocation());
   coordinate = other.coordinate;
   switch (coordinate) {
@@ -70,25 +96,39 @@ void Ray::updateCollision(const Ray &other) {
 }
 
 vec3 Ray::collisionLocation() const {
+  vec3 location;
   switch (coordinate) {
   case Coordinate::UV:
-    return collision->getPosition(uv);
+    location = collision->getPosition(uv);
+    break;
   case Coordinate::BARY:
-    return collision->getPosition(bary);
+    location = collision->getPosition(bary);
+    break;
   default:
     return position + length * direction;
   }
+  return (instance != nullptr) ? instance->toWorld(location) : location;
 }
 
 vec3 Ray::collisionNormal() const {
+  vec3 normal;
   switch (coordinate) {
   case Coordinate::UV:
-    return collision->getNormal(uv);
+    normal = collision->getNormal(uv);
+    break;
   case Coordinate::BARY:
-    return collision->getNormal(bary);
+    normal = collision->getNormal(bary);
+    break;
   default:
-    return collision->normal;
+    normal = collision->normal;
+    break;
   }
+  return (instance != nullptr) ? instance->normalToWorld(normal) : normal;
+}
+
+vec3 Ray::collisionFaceNormal() const {
+  return (instance != nullptr) ? instance->normalToWorld(collision->normal)
+                               : collision->normal;
 }
 
 vec3 Ray::collisionAmbientColour() const {
@@ -113,12 +153,15 @@ vec3 Ray::collisionDiffuseColour() const {
   }
 }
 
+// shaded with the normal in world space, where the light direction is
 vec3 Ray::collisionDiffuseColour(vec3 lightDirection) const {
   switch (coordinate) {
   case Coordinate::UV:
-    return collision->diffuseColour(uv, lightDirection);
+    return collision->diffuseColourNorm(collision->getTexUV(uv),
+                                        lightDirection, collisionNormal());
   case Coordinate::BARY:
-    return collision->diffuseColour(bary, lightDirection);
+    return collision->diffuseColourNorm(collision->getTexUV(bary),
+                                        lightDirection, collisionNormal());
   default:
     return collision->mat->diffuse();
   }
@@ -126,12 +169,24 @@ vec3 Ray::collisionDiffuseColour(vec3 lightDirection) const {
 
 vec3 Ray::collisionSpecularColour(vec3 lightDirection) const {
   switch (coordinate) {
-  case Coordinate::UV:
-    return collision->specularColour(uv, lightDirection, direction);
-  case Coordinate::BARY:
-    return collision->specularColour(bary, lightDirection, direction);
+  case Coordinate::UV: {
+    vec2 texUV = collision->getTexUV(uv);
+    return collision->specularColourNorm(
+        collision->mat->specular(texUV),
+        collision->mat->specularExponent(texUV), lightDirection,
+        collisionNormal(), direction);
+  }
+  case Coordinate::BARY: {
+    vec2 texUV = collision->getTexUV(bary);
+    return collision->specularColourNorm(
+        collision->mat->specular(texUV),
+        collision->mat->specularExponent(texUV), lightDirection,
+        collisionNormal(), direction);
+  }
   default:
-    return collision->specularColour(lightDirection, direction);
+    return collision->specularColourNorm(
+        collision->mat->specular(), collision->mat->specularExponent(),
+        lightDirection, collisionNormal(), direction);
   }
 }
 
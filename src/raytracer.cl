@@ -6,6 +6,12 @@
 #define COLOR(i) triangles[(TRIANGLE_COUNT * 3) + i]
 #define NORM(i) triangles[(TRIANGLE_COUNT * 4) + i]
 #define RELECTIVE(i) properties[i]
+// rays from the light reach the point being lit at a length of one, and only
+// need to search a little beyond it for the point's own triangle
+#define LIGHT_REACH 1.001f
+#ifndef NODE_COUNT
+#define NODE_COUNT 1
+#endif
 typedef struct TriangleStruct {
 	float3 v0;
 	float3 v1;
@@ -29,18 +35,28 @@ typedef struct Basis {
 	float3 z;
 } Basis;
 
+// a node of the bounding volume, laid out as BoundingVolume::Node; the nodes
+// are in depth first order, and an interior node's offset is the index of
+// the node following its subtree
+typedef struct Node {
+	float d[2][7];
+	uint offset;
+	uint count;
+} Node;
+
+#define R3 0.57735026919f
+constant float3 SLAB_NORMALS[7] = {
+	(float3)(1, 0, 0), (float3)(0, 1, 0), (float3)(0, 0, 1),
+	(float3)(R3, R3, R3), (float3)(-R3, R3, R3),
+	(float3)(-R3, -R3, R3), (float3)(R3, -R3, R3)
+};
+
 inline float lerpF(float a, float b, float t) { return a + (b - a) * t; }
 
 inline float dot_product(float3 a, float3 b) {
 	return a.x * b.x + a.y * b.y + a.y * b.y;
 }
 
-inline float det(float3 mat[3]) {
-	return mat[0].x * (mat[1].y * mat[2].z - mat[1].z * mat[2].y) -
-		mat[0].y * (mat[1].x * mat[2].z - mat[1].z * mat[2].x) +
-		mat[0].z * (mat[1].x * mat[2].y - mat[1].y * mat[2].x);
-}
-
 
 inline float3 norm(float3 vec) {
 	float len = native_rsqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
@@ -84,92 +100,87 @@ uint xorshift32(uint seed) {
 	return x;
 }
 
-inline Ray castRayLocal(float3 origin, float3 direction,
-	const global float3 *triangles) {
-	Ray ray;
-	ray.origin = origin;
-	ray.direction = direction;
-	ray.length = FLT_MAX;
-	ray.collision = -1;
-	ray.collisionLocation = (float3) { 0, 0, 0 };
-
-	barrier(CLK_LOCAL_MEM_FENCE);
-	for (int i = 0; i < TRIANGLE_COUNT; i++) {
-		bool intersected = (dot(ray.direction, NORM(i)) < 0) ? true : false;
-		if (intersected) {
-			float3 v0 = V0(i);
-			float3 b = origin - v0;
-			float3 e1 = V1(i) - v0;
-			float3 e2 = V2(i) - v0;
-			float3 A[3] = { -direction, e1, e2 };
-			float det_A = native_recip(det(A));
-			float3 B[3] = { b, e1, e2 };
-			float t = det(B) * det_A;
-			intersected = (t >= 0 && t < ray.length) ? intersected : false;
-			if (intersected) {
-				float3 U[3] = { -ray.direction, b, e2 };
-				float3 V[3] = { -ray.direction, e1, b };
-				float u = det(U) * det_A;
-				float v = det(V) * det_A;
-				intersected = (u >= 0 && v >= 0 && (u + v) <= 1) ? intersected : false;
-				if (intersected) {
-					ray.length = intersected ? t : ray.length;
-					ray.collision = intersected ? i : ray.collision;
-					ray.collisionLocation =
-						intersected ? v0 + u * e1 + v * e2 : ray.collisionLocation;
-				}
-			}
+// shortens the ray to triangle i if it hits its front closer than its length
+// Moller-Trumbore, as on the host: the determinant is negative for triangles
+// facing the ray, and t, u and v share its two cross products
+inline void intersectTriangle(Ray *ray, int i, const global float3 *triangles) {
+	float3 v0 = V0(i);
+	float3 e1 = V1(i) - v0;
+	float3 e2 = V2(i) - v0;
+	float3 p = cross(ray->direction, e2);
+	float det_A = dot(e1, p);
+	if (det_A < 0) {
+		float inverse = native_recip(det_A);
+		float3 b = ray->origin - v0;
+		float3 q = cross(b, e1);
+		float u = dot(b, p) * inverse;
+		float v = dot(ray->direction, q) * inverse;
+		float t = dot(e2, q) * inverse;
+		if (t >= 0 && t < ray->length && u >= 0 && v >= 0 && (u + v) <= 1) {
+			ray->length = t;
+			ray->collision = i;
+			ray->collisionLocation = v0 + u * e1 + v * e2;
 		}
 	}
-	return ray;
 }
 
-inline Ray castRayAdvanced(float3 origin, float3 direction,
-	const global float3 *triangles,
-	const global uchar *properties) {
+// whether the ray enters the node before tMax, given its position and
+// reciprocal direction along each slab normal
+inline bool intersectsNode(const global Node *node, const float *num,
+	const float *inv, float tMax) {
+	float tNear = 0.0f;
+	float tFar = tMax;
+	for (int i = 0; i < 7; i++) {
+		float t0 = (node->d[0][i] - num[i]) * inv[i];
+		float t1 = (node->d[1][i] - num[i]) * inv[i];
+		tNear = max(tNear, min(t0, t1));
+		tFar = min(tFar, max(t0, t1));
+	}
+	return tNear <= tFar;
+}
+
+// walks the nodes in order without a stack, skipping past the subtree of
+// every node the ray misses before reaching length, so that only a node
+// index is kept per ray
+inline Ray castRayLocal(float3 origin, float3 direction, float length,
+	const global float3 *triangles, const global Node *nodes,
+	const global uint *leafTriangles) {
 	Ray ray;
 	ray.origin = origin;
 	ray.direction = direction;
-	ray.length = FLT_MAX;
+	ray.length = length;
 	ray.collision = -1;
 	ray.collisionLocation = (float3) { 0, 0, 0 };
-	for (int i = 0; i < TRIANGLE_COUNT; i++) {
-		bool intersected = (dot(ray.direction, NORM(i)) < 0) ? true : false;
-		if (intersected) {
-			float3 v0 = V0(i);
-			float3 b = origin - v0;
-			float3 e1 = V1(i) - v0;
-			float3 e2 = V2(i) - v0;
-			float3 A[3] = { -direction, e1, e2 };
-			float det_A = native_recip(det(A));
-			float3 B[3] = { b, e1, e2 };
-			float t = det(B) * det_A;
-			intersected = (t >= 0 && t < ray.length) ? intersected : false;
-			if (intersected) {
-				float3 U[3] = { -ray.direction, b, e2 };
-				float3 V[3] = { -ray.direction, e1, b };
-				float u = det(U) * det_A;
-				float v = det(V) * det_A;
-				intersected =
-					(u >= 0 && v >= 0 && (u + v) <= 1) ? intersected : false;
-				if (intersected) {
-					ray.length = intersected ? t : ray.length;
-					ray.collision = intersected ? i : ray.collision;
-					ray.collisionLocation =
-						intersected ? v0 + u * e1 + v * e2 : ray.collisionLocation;
-				}
+
+	float num[7];
+	float inv[7];
+	for (int i = 0; i < 7; i++) {
+		float denom = dot(SLAB_NORMALS[i], direction);
+		denom = (fabs(denom) < 1e-20f) ? ((denom < 0) ? -1e-20f : 1e-20f) : denom;
+		num[i] = dot(SLAB_NORMALS[i], origin);
+		inv[i] = native_recip(denom);
+	}
+
+	int index = 0;
+	while (index < NODE_COUNT) {
+		const global Node *node = &nodes[index];
+		bool hit = intersectsNode(node, num, inv, ray.length);
+		if (hit && node->count != 0) {
+			for (uint i = node->offset; i < node->offset + node->count; i++) {
+				intersectTriangle(&ray, leafTriangles[i], triangles);
 			}
 		}
-
+		index = (hit || node->count != 0) ? index + 1 : (int)node->offset;
 	}
 	return ray;
 }
 
-inline Ray castRayWithReflect(Ray original, const global float3 *triangles, const global uchar *properties) {
+inline Ray castRayWithReflect(Ray original, const global float3 *triangles, const global uchar *properties,
+	const global Node *nodes, const global uint *leafTriangles) {
 	bool reflected = true;
 	Ray ray;
 	while (reflected) {
-		ray = castRayAdvanced(original.origin, original.direction, triangles, properties);
+		ray = castRayLocal(original.origin, original.direction, FLT_MAX, triangles, nodes, leafTriangles);
 		if (ray.collision > -1 && properties[ray.collision] == (uchar)1) {
 			reflected = true;
 			float3 n = NORM(ray.collision);
@@ -213,14 +224,15 @@ inline float3 randomDirection(float r1, float r2, float3 normal) {
 
 // calculates shadows
 kernel void calculateShadows(global const float3 *triangles, global Ray *points,
-	global bool *shadowBuffer, int width, int height) {
+	global bool *shadowBuffer, int width, int height,
+	global const Node *nodes, global const uint *leafTriangles) {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 	int index = (y * width + x);
 	float3 origin = points[index].origin;
 	float3 direction = points[index].direction;
 	int currentTriangle = points[index].collision;
-	Ray result = castRayLocal(origin, direction, triangles);
+	Ray result = castRayLocal(origin, direction, FLT_MAX, triangles, nodes, leafTriangles);
 	shadowBuffer[index] =
 		(result.collision == currentTriangle && currentTriangle > -1) ? true
 		: false;
@@ -229,7 +241,8 @@ kernel void calculateShadows(global const float3 *triangles, global Ray *points,
 kernel void pathTrace(global const float3 *triangles, float3 lightLoc,
 	global Ray *points, global float3 *image, int tCount,
 	int width, int height, global uint *rands,
-	global uchar *properties) {
+	global uchar *properties, global const Node *nodes,
+	global const uint *leafTriangles) {
 
 	int x = get_global_id(0);
 	int y = get_global_id(1);
@@ -239,7 +252,7 @@ kernel void pathTrace(global const float3 *triangles, float3 lightLoc,
 	// DIRECT LIGHT generates and calculates all the ray intersections needed.
 	// Puts the bounce angle in the length property
 	float3 originalLight;
-	Ray lightRay = castRayLocal(lightLoc, cameraRay.collisionLocation - lightLoc, triangles);
+	Ray lightRay = castRayLocal(lightLoc, cameraRay.collisionLocation - lightLoc, LIGHT_REACH, triangles, nodes, leafTriangles);
 	originalLight = directLight(cameraRay, lightLoc, NORM(cameraRay.collision));
 	originalLight = (lightRay.collision == cameraRay.collision) ? originalLight : (float3) { 0, 0, 0 };
 	originalLight = (cameraRay.collision > -1) ? originalLight * (COLOR(cameraRay.collision)) : (float3) { 0.2, 0.2, 0.2 };
@@ -256,7 +269,7 @@ kernel void pathTrace(global const float3 *triangles, float3 lightLoc,
 		Ray bounceRay;
 		bounceRay.direction = direction;
 		bounceRay.origin = ray.collisionLocation;
-		bounces[i] = castRayWithReflect(bounceRay, triangles, properties);
+		bounces[i] = castRayWithReflect(bounceRay, triangles, properties, nodes, leafTriangles);
 		bounces[i].length = r1;
 		seed = xorshift32(seed);
 		r1 = (float)seed / UINT_MAX;
@@ -265,7 +278,7 @@ kernel void pathTrace(global const float3 *triangles, float3 lightLoc,
 	// calculate the direct light for the last bounce.
 	Ray bounceLightRay = castRayLocal(
 		lightLoc, bounces[bounceCount - 1].collisionLocation - lightLoc,
-		triangles);
+		LIGHT_REACH, triangles, nodes, leafTriangles);
 	float3 directLightHere;
 	float3 bounce_n = NORM(bounces[bounceCount - 1].collision);
 	directLightHere = directLight(bounces[bounceCount - 1], lightLoc, bounce_n);
@@ -283,7 +296,7 @@ kernel void pathTrace(global const float3 *triangles, float3 lightLoc,
 	for (int i = bounceCount - 2; i >= 0; i--) {
 		Ray bounceLightRay =
 			castRayLocal(lightLoc, bounces[i].collisionLocation - lightLoc,
-				triangles);
+				LIGHT_REACH, triangles, nodes, leafTriangles);
 		float3 directLightHere;
 		float3 n = NORM(bounces[i].collision);
 		float r1 = bounces[bounceCount + 1].length;
@@ -326,14 +339,16 @@ kernel void flatShade(global const float3 *triangles, float3 lightLoc,
 
 kernel void standardShade(global const float3 *triangles, float3 lightLoc,
 	global Ray *points, global float3 *image, int tCount,
-	int width, int height, global uint *rands) {
+	int width, int height, global uint *rands,
+	global const Node *nodes, global const uint *leafTriangles) {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
 	Ray cameraRay = points[(y * width + x)];
 	// TriangleStruct triangle = triangles[cameraRay.collision];
 	Ray lightRay =
-		castRayLocal(lightLoc, cameraRay.collisionLocation - lightLoc, triangles);
+		castRayLocal(lightLoc, cameraRay.collisionLocation - lightLoc,
+			LIGHT_REACH, triangles, nodes, leafTriangles);
 	int diff = cameraRay.collision - lightRay.collision;
 	float3 ambient = 0.4f;
 
@@ -356,7 +371,8 @@ kernel void standardShade(global const float3 *triangles, float3 lightLoc,
 
 kernel void castRays(global const float3 *triangles, float3 lightLoc,
 	global Ray *points, global float *camera, int tCount,
-	int width, int height, global const uchar *properties) {
+	int width, int height, global const uchar *properties,
+	global const Node *nodes, global const uint *leafTriangles) {
 
 	int x = get_global_id(0);
 	int y = get_global_id(1);
@@ -383,7 +399,7 @@ kernel void castRays(global const float3 *triangles, float3 lightLoc,
 	cameraRay.direction.z = dot(rotation[2], cameraSpaceDirection);
 
 
-	Ray ray = castRayWithReflect(cameraRay, triangles, properties);
+	Ray ray = castRayWithReflect(cameraRay, triangles, properties, nodes, leafTriangles);
 	barrier(CLK_LOCAL_MEM_FENCE);
 	points[(y * width + x)] = ray;
 	return;
@@ -23,19 +23,31 @@ void RayTracer::draw(int width, int height) {
   for (int y = 0; y < margin_y; ++y) {
     for (int x = 0; x < margin_x; ++x) {
       vec3 average(0, 0, 0);
-      for (unsigned i = 0; i < subPixelCount; ++i) {
-        for (unsigned j = 0; j < subPixelCount; ++j) {
+      // the sub-pixel rays all start at the camera and head almost the same
+      // way, so they are traced together in packets
+      const unsigned rayCount = subPixelCount * subPixelCount;
+      for (unsigned first = 0; first < rayCount;
+           first += AccelerationStructure::MAX_PACKET_SIZE) {
+        const unsigned packetSize = std::min(
+            rayCount - first, AccelerationStructure::MAX_PACKET_SIZE);
+
+        Ray cameraRays[AccelerationStructure::MAX_PACKET_SIZE];
+        for (unsigned k = 0; k < packetSize; ++k) {
+          unsigned i = (first + k) / subPixelCount;
+          unsigned j = (first + k) % subPixelCount;
           float super_x =
               static_cast<float>(x) + i / static_cast<float>(subPixelCount);
           float super_y =
               static_cast<float>(y) + j / static_cast<float>(subPixelCount);
-          Ray cameraRay =
+          cameraRays[k] =
               camera.calculateRay(super_x / width, super_y / height);
-
-          if (boundingVolume.calculateIntersection(cameraRay, true)) {
-            average += lighting.calculateLight(cameraRay, glm::ivec2(x, y));
-          }
         }
+
+        TraceStats::setRayType(TraceStats::RayType::Camera);
+        uint64_t hits =
+            boundingVolume.calculateIntersections(cameraRays, packetSize, true);
+        average += lighting.calculateLights(cameraRays, packetSize, hits,
+                                            glm::ivec2(x, y));
       }
       average /= subPixelCount * subPixelCount;
       drawPixel(x, y, vec3(std::min(average.r, 1.0f), std::min(average.g, 1.0f),
@@ -53,6 +65,7 @@ void RayTracer::draw(int width, int height) {
     }
   }
   lighting.countedSamples++;
+  TraceStats::report(cout);
   rows_completed = 0;
   counter_last = 0;
 }
@@ -1,6 +1,8 @@
 #ifdef useCL
 #include "raytracer_cl.h"
 
+#include <unordered_map>
+
 RayTracerCL::RayTracerCL(int width, int height, LightingEngine &lighting,
 	PointLight &light,
 	Ptr_Triangles triangles, const BoundingVolume &boundingVolume, Scene scene, vec3 cameraPos,
@@ -9,8 +11,10 @@ RayTracerCL::RayTracerCL(int width, int height, LightingEngine &lighting,
 	camera(scene.bounds, 2.0f, 6.0f, 30.0f), light(light),
 	lighting(lighting), boundingVolume(boundingVolume), averageImage(vector<vec3>(width*height)) { 
 
-	gpu = getGPU(triangles.size());
+	BoundingVolume::Nodes nodes = boundingVolume.stackless();
+	gpu = getGPU(triangles.size(), nodes.size());
 	create_global_memory(width, height);
+	upload_bounding_volume(nodes);
 	int err = 0;
 	gpu.queue.enqueueWriteBuffer(triangleBuffer, CL_TRUE, 0, sizeof(cl_float3) * triangles.size()*5, cl_triangles);
 
@@ -28,6 +32,8 @@ RayTracerCL::RayTracerCL(int width, int height, LightingEngine &lighting,
 	castRays.setArg(5, (cl_int)width);
 	castRays.setArg(6, (cl_int)height);
 	castRays.setArg(7, iCantBelieveItsNotBuffer);
+	castRays.setArg(8, nodeBuffer);
+	castRays.setArg(9, leafTriangleBuffer);
 
 	shader = cl::Kernel(gpu.program, "pathTrace", &err);
 	if (err != 0) {
@@ -42,6 +48,8 @@ RayTracerCL::RayTracerCL(int width, int height, LightingEngine &lighting,
 	shader.setArg(6, (cl_int)height);
 	shader.setArg(7, randBuffer); 
 	shader.setArg(8, iCantBelieveItsNotBuffer);
+	shader.setArg(9, nodeBuffer);
+	shader.setArg(10, leafTriangleBuffer);
 
 #pragma omp parallel for 
 	for (int y = 0; y < height; ++y) {
@@ -92,6 +100,25 @@ void RayTracerCL::create_global_memory(int width, int height) {
 	}
 }
 
+void RayTracerCL::upload_bounding_volume(const BoundingVolume::Nodes &nodes) {
+	std::unordered_map<Ptr_Triangle, cl_uint> indices;
+	for (size_t i = 0; i < triangles.size(); i++) {
+		indices[triangles[i]] = static_cast<cl_uint>(i);
+	}
+	vector<cl_uint> leafTriangles;
+	for (Ptr_Triangle triangle : boundingVolume.getTriangles()) {
+		leafTriangles.push_back(indices[triangle]);
+	}
+
+	nodeBuffer = cl::Buffer(gpu.context, CL_MEM_READ_ONLY, sizeof(BoundingVolume::Node) * nodes.size());
+	leafTriangleBuffer = cl::Buffer(gpu.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * leafTriangles.size());
+	int err = gpu.queue.enqueueWriteBuffer(nodeBuffer, CL_TRUE, 0, sizeof(BoundingVolume::Node) * nodes.size(), nodes.data());
+	err |= gpu.queue.enqueueWriteBuffer(leafTriangleBuffer, CL_TRUE, 0, sizeof(cl_uint) * leafTriangles.size(), leafTriangles.data());
+	if (err != 0) {
+		cout << "error enqueueing bounding volume buffers " << err << "\n";
+	}
+}
+
 void RayTracerCL::update(float dt) {
 	if (light.update(dt)) {
 		refresh = true;
@@ -7,10 +7,14 @@ StandardLighting::StandardLighting(const Scene &scene)
 vec3 StandardLighting::calculateLight(Ray &cameraRay, ivec2 pixel) {
   vec3 lightColour = ambientLight * cameraRay.collisionAmbientColour();
 
+  TraceStats::setRayType(TraceStats::RayType::Shadow);
+
   // calculate average light at a point -- works with multiple light rays
   for (Ray &lightRay : light.calculateRays(cameraRay.collisionLocation())) {
-    if (boundingVolume.calculateAnyIntersection(lightRay, cameraRay, false) &&
-        lightRay.getCollision() == cameraRay.getCollision()) {
+    // triangles are only lit from the front
+    if (glm::dot(cameraRay.collisionFaceNormal(), lightRay.getDirection()) <
+            0.0f &&
+        !boundingVolume.calculateAnyIntersection(lightRay)) {
 
       lightColour +=
           light.directLight(lightRay) *
@@ -20,3 +24,50 @@ vec3 StandardLighting::calculateLight(Ray &cameraRay, ivec2 pixel) {
   }
   return lightColour;
 }
+
+vec3 StandardLighting::calculateLights(Ray *cameraRays, unsigned count,
+                                       uint64_t hits, ivec2 pixel) {
+  vec3 lightColour(0, 0, 0);
+
+  TraceStats::setRayType(TraceStats::RayType::Shadow);
+
+  // light rays are picked a packet at a time as they are traced, rather than
+  // every camera ray's being collected first
+  vec3 locations[AccelerationStructure::MAX_PACKET_SIZE];
+  for (unsigned k = 0; k < count; k++) {
+    if (hits & (uint64_t(1) << k)) {
+      lightColour += ambientLight * cameraRays[k].collisionAmbientColour();
+      locations[k] = cameraRays[k].collisionLocation();
+    }
+  }
+
+  for (int l = 0; l < light.rayCount; l++) {
+    Ray shadowRays[AccelerationStructure::MAX_PACKET_SIZE];
+    unsigned owners[AccelerationStructure::MAX_PACKET_SIZE];
+    unsigned shadowCount = 0;
+    for (unsigned k = 0; k < count; k++) {
+      if (!(hits & (uint64_t(1) << k))) {
+        continue;
+      }
+      shadowRays[shadowCount] = light.calculateRay(locations[k]);
+      // triangles are only lit from the front
+      if (glm::dot(cameraRays[k].collisionFaceNormal(),
+                   shadowRays[shadowCount].getDirection()) < 0.0f) {
+        owners[shadowCount++] = k;
+      }
+    }
+
+    const uint64_t blocked =
+        boundingVolume.calculateAnyIntersections(shadowRays, shadowCount);
+    for (unsigned s = 0; s < shadowCount; s++) {
+      if (!(blocked & (uint64_t(1) << s))) {
+        const Ray &cameraRay = cameraRays[owners[s]];
+        const vec3 direction = shadowRays[s].getDirection();
+        lightColour += light.directLight(shadowRays[s]) *
+                       (cameraRay.collisionDiffuseColour(direction) +
+                        cameraRay.collisionSpecularColour(direction));
+      }
+    }
+  }
+  return lightColour;
+}
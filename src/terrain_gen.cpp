@@ -1,16 +1,15 @@
 #include "terrain_gen.h"
 
-const shared_ptr<const vector<Triangle>>
-TerrainGenerator::makePlane(float width, int resolution, vec3 pos) {
-  shared_ptr<vector<Triangle>> triangles = make_shared<vector<Triangle>>();
-  /*shared_ptr<Material> marble = make_shared<Material>();
+#include <cmath>
 
-  marble->loadPNG();
+vector<Triangle *> TerrainGenerator::makePlane(float width, int resolution,
+                                               vec3 pos,
+                                               const Material *material) {
+  vector<Triangle *> triangles;
   vec2 bl(0.0f, 1.0f);
   vec2 br(1.0f, 1.0f);
   vec2 tl(0.0f, 0.0f);
   vec2 tr(1.0f, 0.0f);
-  vec3 white(0.75f, 0.75f, 0.75f);
   float squareWidth = width / static_cast<float>(resolution);
   for (int x = 0; x < resolution; x++) {
     for (int z = 0; z < resolution; z++) {
@@ -18,17 +17,36 @@ TerrainGenerator::makePlane(float width, int resolution, vec3 pos) {
       vec3 v2(squareWidth * (x + 1), 0, squareWidth * z);
       vec3 v3(squareWidth * x, 0, squareWidth * (z + 1));
       vec3 v4(squareWidth * (x + 1), 0, squareWidth * (z + 1));
-      triangles->push_back(
-          Triangle(v1 + pos, v2 + pos, v3 + pos, tl, br, bl, white, marble));
-      triangles->push_back(
-          Triangle(v4 + pos, v3 + pos, v2 + pos, tl, tr, br, white, marble));
+      triangles.push_back(
+          new Triangle(v1 + pos, v2 + pos, v3 + pos, tl, br, bl, material));
+      triangles.push_back(
+          new Triangle(v4 + pos, v3 + pos, v2 + pos, tl, tr, br, material));
     }
-  }*/
+  }
   return triangles;
 }
 
-const shared_ptr<const vector<Triangle>>
-TerrainGenerator::generateTerrain(float width, int maxHeight, int resolution,
-                                  vec3 pos) {
-  return makePlane(width, resolution, pos);
+// a few crossing waves, scaled to lie between zero and maxHeight
+float TerrainGenerator::height(float width, int maxHeight, float x, float z) {
+  const float tau = 2.0f * static_cast<float>(M_PI);
+  float u = x / width;
+  float v = z / width;
+  return maxHeight * (0.5f + 0.25f * std::sin(tau * 2.0f * u) *
+                                 std::cos(tau * 3.0f * v) +
+                      0.25f * std::sin(tau * (5.0f * u + 4.0f * v)));
+}
+
+vector<Triangle *> TerrainGenerator::generateTerrain(float width,
+                                                     int maxHeight,
+                                                     int resolution, vec3 pos,
+                                                     const Material *material) {
+  vector<Triangle *> triangles = makePlane(width, resolution, pos, material);
+  for (Triangle *triangle : triangles) {
+    vec3 vertices[3] = {triangle->v0, triangle->v1, triangle->v2};
+    for (vec3 &vertex : vertices) {
+      vertex.y += height(width, maxHeight, vertex.x - pos.x, vertex.z - pos.z);
+    }
+    triangle->setVertices(vertices[0], vertices[1], vertices[2]);
+  }
+  return triangles;
 }
@@ -0,0 +1,251 @@
+#include "toplevelvolume.h"
+
+TopLevelVolume::TopLevelVolume(const vector<Instance> &instances)
+    : instances(instances) {
+  build();
+}
+
+vector<Instance> TopLevelVolume::grid(const AccelerationStructure &volume,
+                                      const Cube &objectBounds,
+                                      unsigned size) {
+  vec3 extent = objectBounds.b - objectBounds.a;
+  vec3 centre = 0.5f * (objectBounds.a + objectBounds.b);
+  // far enough apart that copies never overlap however they are turned
+  float spacing = 1.5f * std::max(std::max(extent.x, extent.y), extent.z);
+  float turn = 2.0f * static_cast<float>(M_PI) / (size * size * size);
+
+  vector<Instance> instances;
+  for (unsigned x = 0; x < size; x++) {
+    for (unsigned y = 0; y < size; y++) {
+      for (unsigned z = 0; z < size; z++) {
+        float angle = turn * instances.size();
+        mat3 rotation(cos(angle), 0.0f, -sin(angle), 0.0f, 1.0f, 0.0f,
+                      sin(angle), 0.0f, cos(angle));
+        // turned about its own centre
+        instances.emplace_back(volume, objectBounds, rotation,
+                               centre - rotation * centre +
+                                   spacing * vec3(x, y, z));
+      }
+    }
+  }
+
+  return instances;
+}
+
+const vector<Instance> &TopLevelVolume::getInstances() const {
+  return instances;
+}
+
+void TopLevelVolume::moveInstance(unsigned index, mat3 transform,
+                                  vec3 translation) {
+  instances[index].setTransform(transform, translation);
+  build();
+}
+
+Cube TopLevelVolume::getBounds() const {
+  float maxFloat = numeric_limits<float>::max();
+  vec3 minBound(maxFloat, maxFloat, maxFloat);
+  vec3 maxBound(-maxFloat, -maxFloat, -maxFloat);
+
+  for (const Instance &instance : instances) {
+    const Cube &bounds = instance.getBounds();
+    minBound.x = std::min(bounds.a.x, minBound.x);
+    minBound.y = std::min(bounds.a.y, minBound.y);
+    minBound.z = std::min(bounds.a.z, minBound.z);
+    maxBound.x = std::max(bounds.b.x, maxBound.x);
+    maxBound.y = std::max(bounds.b.y, maxBound.y);
+    maxBound.z = std::max(bounds.b.z, maxBound.z);
+  }
+
+  return Cube(minBound, maxBound);
+}
+
+// there are few enough instances that splitting at the median centroid along
+// the widest axis builds in well under a millisecond, so the whole level is
+// rebuilt whenever anything moves
+void TopLevelVolume::build() {
+  nodes.clear();
+  order.clear();
+  if (instances.empty()) {
+    return;
+  }
+
+  vector<vec3> centroids;
+  for (const Instance &instance : instances) {
+    const Cube &bounds = instance.getBounds();
+    centroids.push_back(0.5f * (bounds.a + bounds.b));
+    order.push_back(order.size());
+  }
+
+  nodes.reserve(2 * instances.size() - 1);
+  nodes.emplace_back();
+  buildSub(0, order.data(), order.data() + order.size(), centroids);
+}
+
+void TopLevelVolume::buildSub(unsigned index, unsigned *begin, unsigned *end,
+                              const vector<vec3> &centroids) {
+  fitNode(index, begin, end);
+
+  if (end - begin == 1) {
+    nodes[index].offset = begin - order.data();
+    nodes[index].count = 1;
+    return;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  vec3 minBound(maxFloat, maxFloat, maxFloat);
+  vec3 maxBound(-maxFloat, -maxFloat, -maxFloat);
+  for (const unsigned *i = begin; i != end; ++i) {
+    minBound = glm::min(minBound, centroids[*i]);
+    maxBound = glm::max(maxBound, centroids[*i]);
+  }
+
+  vec3 extent = maxBound - minBound;
+  int axis = 0;
+  if (extent.y > extent[axis]) {
+    axis = 1;
+  }
+  if (extent.z > extent[axis]) {
+    axis = 2;
+  }
+
+  unsigned *middle = begin + (end - begin) / 2;
+  std::nth_element(begin, middle, end, [&](unsigned a, unsigned b) {
+    return centroids[a][axis] < centroids[b][axis];
+  });
+
+  unsigned first = nodes.size();
+  nodes[index].offset = first;
+  nodes[index].count = 0;
+  nodes.emplace_back();
+  nodes.emplace_back();
+
+  buildSub(first, begin, middle, centroids);
+  buildSub(first + 1, middle, end, centroids);
+}
+
+// the node is bounded by the seven slabs around the corners of each
+// instance's object bounds, placed in the world
+void TopLevelVolume::fitNode(unsigned index, const unsigned *begin,
+                             const unsigned *end) {
+  BoundingVolume::Node &node = nodes[index];
+  for (int i = 0; i < 7; i++) {
+    node.d[0][i] = numeric_limits<float>::max();
+    node.d[1][i] = -numeric_limits<float>::max();
+  }
+
+  for (const unsigned *i = begin; i != end; ++i) {
+    for (const vec3 &corner : instances[*i].getCorners()) {
+      for (int j = 0; j < 7; j++) {
+        float d = glm::dot(BoundingVolume::normals[j], corner);
+        node.d[0][j] = std::min(node.d[0][j], d);
+        node.d[1][j] = std::max(node.d[1][j], d);
+      }
+    }
+  }
+}
+
+// the same front to back walk as the bounding volume's, tracing the ray
+// through each instance it reaches in that instance's own space
+bool TopLevelVolume::closestIntersection(Ray &ray) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const BoundingVolume::RaySlabs slabs(ray);
+
+  float tNear;
+  if (!BoundingVolume::intersectsNode(nodes[0], slabs, ray.getLength(),
+                                      tNear)) {
+    return false;
+  }
+
+  bool anyIntersection = false;
+
+  struct {
+    unsigned index;
+    float tNear;
+  } stack[STACK_SIZE];
+  unsigned stackSize = 0;
+  unsigned index = 0;
+
+  while (true) {
+    const BoundingVolume::Node &node = nodes[index];
+    TraceStats::countNode();
+    if (node.isLeaf()) {
+      const Instance &instance = instances[order[node.offset]];
+      float scale;
+      Ray objectRay = instance.toObject(ray, scale);
+      if (instance.getVolume().closestIntersection(objectRay)) {
+        ray.updateCollision(objectRay, &instance,
+                            objectRay.getLength() / scale);
+        anyIntersection = true;
+      }
+    } else {
+      float tFirst, tSecond;
+      bool first = BoundingVolume::intersectsNode(
+          nodes[node.offset], slabs, ray.getLength(), tFirst);
+      bool second = BoundingVolume::intersectsNode(
+          nodes[node.offset + 1], slabs, ray.getLength(), tSecond);
+
+      if (first && second) {
+        if (tSecond < tFirst) {
+          stack[stackSize++] = {node.offset, tFirst};
+          index = node.offset + 1;
+        } else {
+          stack[stackSize++] = {node.offset + 1, tSecond};
+          index = node.offset;
+        }
+        continue;
+      } else if (first || second) {
+        index = first ? node.offset : node.offset + 1;
+        continue;
+      }
+    }
+
+    do {
+      if (stackSize == 0) {
+        return anyIntersection;
+      }
+      --stackSize;
+    } while (stack[stackSize].tNear > ray.getLength());
+    index = stack[stackSize].index;
+  }
+}
+
+bool TopLevelVolume::anySegmentIntersection(const Ray &segment) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const BoundingVolume::RaySlabs slabs(segment);
+
+  unsigned stack[STACK_SIZE];
+  unsigned stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize != 0) {
+    const BoundingVolume::Node &node = nodes[stack[--stackSize]];
+    TraceStats::countNode();
+
+    float tNear;
+    if (!BoundingVolume::intersectsNode(node, slabs, segment.getLength(),
+                                        tNear)) {
+      continue;
+    }
+
+    if (node.isLeaf()) {
+      const Instance &instance = instances[order[node.offset]];
+      float scale;
+      if (instance.getVolume().anySegmentIntersection(
+              instance.toObject(segment, scale))) {
+        return true;
+      }
+    } else {
+      stack[stackSize++] = node.offset + 1;
+      stack[stackSize++] = node.offset;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,43 @@
+#include "tracestats.h"
+
+TraceStats::Threads TraceStats::threads(omp_get_max_threads());
+
+void TraceStats::collect(Counts counts[RAY_TYPES]) {
+  for (unsigned type = 0; type < RAY_TYPES; type++) {
+    counts[type] = {0, 0, 0};
+  }
+
+  for (ThreadCounts &thread : threads) {
+    for (unsigned type = 0; type < RAY_TYPES; type++) {
+      counts[type].rays += thread.counts[type].rays;
+      counts[type].nodes += thread.counts[type].nodes;
+      counts[type].triangles += thread.counts[type].triangles;
+      thread.counts[type] = {0, 0, 0};
+    }
+  }
+
+  if (threads.size() != static_cast<size_t>(omp_get_max_threads())) {
+    threads.assign(omp_get_max_threads(), ThreadCounts());
+  }
+}
+
+void TraceStats::report(std::ostream &out) {
+#ifdef TRACE_STATS
+  const char *names[RAY_TYPES] = {"camera", "shadow", "bounce"};
+
+  Counts counts[RAY_TYPES];
+  collect(counts);
+
+  for (unsigned type = 0; type < RAY_TYPES; type++) {
+    if (counts[type].rays == 0) {
+      continue;
+    }
+
+    const double rays = static_cast<double>(counts[type].rays);
+    out << names[type] << ": " << counts[type].rays << " rays, "
+        << counts[type].nodes / rays << " nodes and "
+        << counts[type].triangles / rays << " triangles per ray"
+        << std::endl;
+  }
+#endif
+}
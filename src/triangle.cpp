@@ -19,28 +19,48 @@ Triangle::Triangle(vec3 v0, vec3 v1, vec3 v2, vec2 vt0, vec2 vt1, vec2 vt2,
       en1(vn1 - vn0), en2(vn2 - vn0), normal(calculateNormal(v0, v1, v2)),
       mat(mat) {}
 
+void Triangle::setVertices(vec3 v0, vec3 v1, vec3 v2) {
+  vec3 normal = calculateNormal(v0, v1, v2);
+  setVertices(v0, v1, v2, normal, normal, normal);
+}
+
+void Triangle::setVertices(vec3 v0, vec3 v1, vec3 v2, vec3 vn0, vec3 vn1,
+                           vec3 vn2) {
+  this->v0 = v0;
+  this->v1 = v1;
+  this->v2 = v2;
+  e1 = v1 - v0;
+  e2 = v2 - v0;
+  this->vn0 = vn0;
+  this->vn1 = vn1;
+  this->vn2 = vn2;
+  en1 = vn1 - vn0;
+  en2 = vn2 - vn0;
+  normal = calculateNormal(v0, v1, v2);
+}
+
+bool Triangle::intersects(const Ray &ray, float &t, vec2 &uv) const {
+  return intersects(ray.getPosition(), ray.getDirection(), ray.getLength(),
+                    v0, e1, e2, t, uv);
+}
+
 bool Triangle::calculateIntersection(Ray &ray) const {
-  if (glm::dot(normal, ray.getDirection()) < 0) {
-    vec3 b = ray.getPosition() - v0;
-
-    glm::mat3 A(-ray.getDirection(), e1, e2);
-    auto det_A = glm::determinant(A);
-
-    auto t = glm::determinant(glm::mat3(b, e1, e2)) / det_A;
-    if (t >= 0 && t < ray.getLength()) {
-      auto u = glm::determinant(glm::mat3(-ray.getDirection(), b, e2)) / det_A;
-      auto v = glm::determinant(glm::mat3(-ray.getDirection(), e1, b)) / det_A;
-
-      if (u >= 0.0f && v >= 0.0f && (u + v) < 1.0f) {
-        ray.updateCollision(this, t, vec2(u, v));
-        return true;
-      }
-    }
+  float t;
+  vec2 uv;
+  if (intersects(ray, t, uv)) {
+    ray.updateCollision(this, t, uv);
+    return true;
   }
 
   return false;
 }
 
+bool Triangle::calculateAnyIntersection(const Ray &ray) const {
+  float t;
+  vec2 uv;
+  return intersects(ray, t, uv);
+}
+
 // Position
 
 vector<vec3> Triangle::getVertices() const { return {v0, v1, v2}; }
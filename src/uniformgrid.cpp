@@ -0,0 +1,211 @@
+#include "uniformgrid.h"
+
+#include <cmath>
+
+const int UniformGrid::MAX_RESOLUTION;
+
+// reciprocal that stays finite for directions parallel to an axis
+static float reciprocal(float x) {
+  const float minimum = 1e-20f;
+  if (std::abs(x) < minimum) {
+    x = (x < 0.0f) ? -minimum : minimum;
+  }
+  return 1.0f / x;
+}
+
+// cells are made as near to cubes as the scene allows, their number growing
+// with the number of triangles; the triangles are then counted into the
+// cells their boxes overlap and listed in one array, cell after cell
+UniformGrid::UniformGrid(const Ptr_Triangles &triangles)
+    : min(), max(), cellSize(1.0f, 1.0f, 1.0f), resolution{1, 1, 1} {
+  cellStart.assign(2, 0);
+  if (triangles.empty()) {
+    return;
+  }
+
+  float maxFloat = numeric_limits<float>::max();
+  min = vec3(maxFloat, maxFloat, maxFloat);
+  max = vec3(-maxFloat, -maxFloat, -maxFloat);
+  for (const Ptr_Triangle &triangle : triangles) {
+    min = glm::min(min, glm::min(glm::min(triangle->v0, triangle->v1),
+                                 triangle->v2));
+    max = glm::max(max, glm::max(glm::max(triangle->v0, triangle->v1),
+                                 triangle->v2));
+  }
+
+  const vec3 extent = max - min;
+  const float widest = std::max(std::max(extent.x, extent.y), extent.z);
+  float volume = 1.0f;
+  int dimensions = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] > FLAT_EXTENT * widest) {
+      volume *= extent[axis];
+      ++dimensions;
+    }
+  }
+
+  const float cellWidth =
+      (dimensions == 0)
+          ? 1.0f
+          : std::pow(volume / (CELL_DENSITY * triangles.size()),
+                     1.0f / dimensions);
+  for (int axis = 0; axis < 3; axis++) {
+    resolution[axis] = 1;
+    if (extent[axis] > FLAT_EXTENT * widest) {
+      resolution[axis] = std::min(
+          std::max(static_cast<int>(std::round(extent[axis] / cellWidth)), 1),
+          MAX_RESOLUTION);
+    }
+    cellSize[axis] = (extent[axis] > 0.0f) ? extent[axis] / resolution[axis]
+                                           : 1.0f;
+  }
+
+  const unsigned cells = cellCount();
+  vector<unsigned> counts(cells + 1, 0);
+
+  // first counting the triangles in each cell, then filling each cell's
+  // range of the array
+  for (int pass = 0; pass < 2; pass++) {
+    for (const Ptr_Triangle &triangle : triangles) {
+      vec3 lo = glm::min(glm::min(triangle->v0, triangle->v1), triangle->v2);
+      vec3 hi = glm::max(glm::max(triangle->v0, triangle->v1), triangle->v2);
+      int from[3], to[3];
+      for (int axis = 0; axis < 3; axis++) {
+        from[axis] = cellAlong(axis, lo[axis]);
+        to[axis] = cellAlong(axis, hi[axis]);
+      }
+
+      for (int z = from[2]; z <= to[2]; z++) {
+        for (int y = from[1]; y <= to[1]; y++) {
+          for (int x = from[0]; x <= to[0]; x++) {
+            unsigned cell =
+                (z * resolution[1] + y) * resolution[0] + x;
+            if (pass == 0) {
+              ++counts[cell];
+            } else {
+              cellTriangles[counts[cell]++] = triangle;
+            }
+          }
+        }
+      }
+    }
+
+    if (pass == 0) {
+      cellStart.assign(cells + 1, 0);
+      for (unsigned cell = 0; cell < cells; cell++) {
+        cellStart[cell + 1] = cellStart[cell] + counts[cell];
+      }
+      cellTriangles.resize(cellStart[cells]);
+      std::copy(cellStart.begin(), cellStart.end(), counts.begin());
+    }
+  }
+
+  packed = PackedTriangles(cellTriangles);
+}
+
+int UniformGrid::cellAlong(int axis, float position) const {
+  int cell = static_cast<int>((position - min[axis]) / cellSize[axis]);
+  return std::min(std::max(cell, 0), resolution[axis] - 1);
+}
+
+unsigned UniformGrid::cellCount() const {
+  return resolution[0] * resolution[1] * resolution[2];
+}
+
+size_t UniformGrid::referenceCount() const { return cellTriangles.size(); }
+
+// steps from cell to cell across whichever cell boundary the ray meets first,
+// keeping the distance to the next boundary along each axis
+template <typename Visit>
+void UniformGrid::walk(const Ray &ray, Visit visit) const {
+  if (cellTriangles.empty()) {
+    return;
+  }
+
+  const vec3 position = ray.getPosition();
+  const vec3 direction = ray.getDirection();
+  const vec3 inverse(reciprocal(direction.x), reciprocal(direction.y),
+                     reciprocal(direction.z));
+
+  float tEntry = 0.0f;
+  float tExit = ray.getLength();
+  for (int axis = 0; axis < 3; axis++) {
+    float t0 = (min[axis] - position[axis]) * inverse[axis];
+    float t1 = (max[axis] - position[axis]) * inverse[axis];
+    tEntry = std::max(tEntry, std::min(t0, t1));
+    tExit = std::min(tExit, std::max(t0, t1));
+  }
+  if (tEntry > tExit) {
+    return;
+  }
+
+  const vec3 entry = position + tEntry * direction;
+  int cell[3], step[3], end[3];
+  float tNext[3], tDelta[3];
+  for (int axis = 0; axis < 3; axis++) {
+    cell[axis] = cellAlong(axis, entry[axis]);
+    if (direction[axis] > 0.0f) {
+      step[axis] = 1;
+      end[axis] = resolution[axis];
+      tNext[axis] = (min[axis] + (cell[axis] + 1) * cellSize[axis] -
+                     position[axis]) *
+                    inverse[axis];
+      tDelta[axis] = cellSize[axis] * inverse[axis];
+    } else if (direction[axis] < 0.0f) {
+      step[axis] = -1;
+      end[axis] = -1;
+      tNext[axis] =
+          (min[axis] + cell[axis] * cellSize[axis] - position[axis]) *
+          inverse[axis];
+      tDelta[axis] = -cellSize[axis] * inverse[axis];
+    } else {
+      step[axis] = 0;
+      end[axis] = -1;
+      tNext[axis] = numeric_limits<float>::max();
+      tDelta[axis] = 0.0f;
+    }
+  }
+
+  while (true) {
+    int axis = (tNext[0] < tNext[1]) ? 0 : 1;
+    if (tNext[2] < tNext[axis]) {
+      axis = 2;
+    }
+
+    const unsigned index =
+        (cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+    TraceStats::countNode();
+    if (visit(cellStart[index], cellStart[index + 1], tNext[axis]) ||
+        tNext[axis] >= tExit) {
+      return;
+    }
+
+    cell[axis] += step[axis];
+    if (cell[axis] == end[axis]) {
+      return;
+    }
+    tNext[axis] += tDelta[axis];
+  }
+}
+
+// a triangle may reach beyond the cell it was found in, so the walk only
+// stops once the closest hit is no further than the cell's far side
+bool UniformGrid::closestIntersection(Ray &ray) const {
+  bool anyIntersection = false;
+  walk(ray, [&](unsigned first, unsigned last, float tCellExit) {
+    TraceStats::countTriangle(last - first);
+    anyIntersection |= packed.calculateIntersection(first, last - first, ray);
+    return anyIntersection && ray.getLength() <= tCellExit;
+  });
+  return anyIntersection;
+}
+
+bool UniformGrid::anySegmentIntersection(const Ray &segment) const {
+  bool blocked = false;
+  walk(segment, [&](unsigned first, unsigned last, float) {
+    TraceStats::countTriangle(last - first);
+    blocked = packed.calculateAnyIntersection(first, last - first, segment);
+    return blocked;
+  });
+  return blocked;
+}